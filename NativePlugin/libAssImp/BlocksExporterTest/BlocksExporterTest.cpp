@@ -1,7 +1,16 @@
 #include <iostream>
 #include <string>
 #include <random>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <map>
 #include "DllExports.h"
+#include "NativeOctree\ItemIdMap.h"
+#include "NativeOctree\EpochReclaimer.h"
+#include "NativeOctree\SpatialIndex.h"
 
 void dummylog(const char * logLine) {
 	std::cout << logLine << std::endl;
@@ -11,7 +20,32 @@ void EmitModel(std::string filename, int matId);
 
 void generatedTest();
 
-void main() {
+void benchmarkItemUpdates();
+
+int testUnknownItemIds();
+
+int testItemIdMap();
+
+int testNestedReadGuards();
+
+int testConcurrentReaders();
+
+int testPagedQueries();
+
+int testBackends();
+
+int testSnapshots();
+
+int testDeferredUpdates();
+
+/// Runs the smoke tests, and the benchmarks too when given --benchmark. Returns the number of failed checks.
+int main(int argc, char** argv) {
+	bool runBenchmarks = false;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--benchmark") {
+			runBenchmarks = true;
+		}
+	}
 	SetDebugFunction(&dummylog);
 	std::cout << "Hello, world." << std::endl;
 	EmitModel("test_model.fbx", 8);
@@ -88,11 +122,566 @@ void main() {
 	resultCount = SpatialPartitionerIntersectedBy(spaceId2, targetCenter, targetExtents, results, 1000);
 	std::cout << "Collision test found " << resultCount << " collisions" << std::endl;
 
+	int failures = testUnknownItemIds() + testItemIdMap();
+	std::cout << "Item id tests: " << failures << " failures" << std::endl;
+	int readerFailures = testNestedReadGuards() + testConcurrentReaders();
+	std::cout << "Concurrent reader test: " << readerFailures << " failures" << std::endl;
+	failures += readerFailures;
+	int backendFailures = testBackends();
+	std::cout << "Backend tests: " << backendFailures << " failures" << std::endl;
+	failures += backendFailures;
+	int snapshotFailures = testSnapshots();
+	std::cout << "Snapshot test: " << snapshotFailures << " failures" << std::endl;
+	failures += snapshotFailures;
+	int deferredFailures = testDeferredUpdates();
+	std::cout << "Deferred update test: " << deferredFailures << " failures" << std::endl;
+	failures += deferredFailures;
+	int pagedFailures = testPagedQueries();
+	std::cout << "Paged query test: " << pagedFailures << " failures" << std::endl;
+	failures += pagedFailures;
+
+	if (runBenchmarks) {
+		benchmarkItemUpdates();
+	}
+
 	Debug("Done");
 	//EmitModel("Gem.dae", 25);
 	temp;
 	std::cin >> temp;
+	return failures;
+}
+
+/// Prints message and returns 1 if passed is false, so callers can add up the failures.
+int check(bool passed, const char* message) {
+	if (!passed) {
+		std::cout << "FAILED: " << message << std::endl;
+	}
+	return passed ? 0 : 1;
+}
+
+/// Checks that SpatialPartitionerUpdateItem and SpatialPartitionerRemoveItem ignore ids that were never added or
+/// were already removed, and leave the other items alone.
+int testUnknownItemIds() {
+	int failures = 0;
+	Vector3 worldCenter(0, 0, 0);
+	Vector3 worldSize(100, 100, 100);
+	Vector3 origin(0, 0, 0);
+	Vector3 distant(20, 20, 20);
+	Vector3 small(0.5f, 0.5f, 0.5f);
+	Vector3 everything(50, 50, 50);
+	int results[16];
+	int spaceId = AllocSpatialPartitioner(worldCenter, worldSize);
+	SpatialPartitionerAddItem(spaceId, 1, origin, small);
+	SpatialPartitionerAddItem(spaceId, 2, distant, small);
+
+	SpatialPartitionerUpdateItem(spaceId, 99, origin, small);
+	int count = SpatialPartitionerIntersectedBy(spaceId, origin, small, results, 16);
+	failures += check(count == 1 && results[0] == 1, "updating an unknown id added an item");
+
+	SpatialPartitionerRemoveItem(spaceId, 99);
+	count = SpatialPartitionerIntersectedBy(spaceId, origin, everything, results, 16);
+	failures += check(count == 2, "removing an unknown id removed an item");
+
+	SpatialPartitionerRemoveItem(spaceId, 1);
+	SpatialPartitionerRemoveItem(spaceId, 1);
+	SpatialPartitionerUpdateItem(spaceId, 1, distant, small);
+	count = SpatialPartitionerIntersectedBy(spaceId, origin, everything, results, 16);
+	failures += check(count == 1 && results[0] == 2, "a removed id came back or took another item with it");
+
+	SpatialPartitionerUpdateItem(spaceId, 2, origin, small);
+	count = SpatialPartitionerIntersectedBy(spaceId, origin, small, results, 16);
+	failures += check(count == 1 && results[0] == 2, "a known id was not updated after unknown ones");
+
+	FreeSpatialPartitioner(spaceId);
+	return failures;
+}
+
+/// Checks that ItemIdMap returns every id's element through growth, overwrites and erases in random order, which
+/// shift the entries probing past an erased one back into its place.
+int testItemIdMap() {
+	int failures = 0;
+	const int idCount = 5000;
+	std::vector<int> ids(idCount);
+	for (int i = 0; i < idCount; i++) {
+		// Scattered, including negative ids, as callers choose them.
+		ids[i] = (i - idCount / 2) * 1021 + 13;
+	}
+	std::default_random_engine generator;
+	std::shuffle(ids.begin(), ids.end(), generator);
+
+	ItemIdMap map;
+	for (int i = 0; i < idCount; i++) {
+		map.Set(ids[i], i);
+	}
+	for (int i = 0; i < idCount; i += 2) {
+		map.Set(ids[i], idCount + i);
+	}
+	failures += check(map.Size() == (size_t)idCount, "overwriting an id changed the map size");
+
+	int wrong = 0;
+	for (int i = 0; i < idCount; i++) {
+		int expected = i % 2 == 0 ? idCount + i : i;
+		wrong += map.Find(ids[i]) != expected ? 1 : 0;
+	}
+	failures += check(wrong == 0, "an id did not round-trip to its element");
+	failures += check(map.Find(7) == ItemIdMap::kMissing, "an id never added was found");
+
+	// Erase every third id, then check that the ones left are all still found, since each erase moved the entries
+	// that probed past it.
+	std::vector<bool> erased(idCount, false);
+	bool erasedAll = true;
+	for (int i = 0; i < idCount; i += 3) {
+		erasedAll = map.Erase(ids[i]) && erasedAll;
+		erased[i] = true;
+	}
+	failures += check(erasedAll, "erasing a present id returned false");
+	failures += check(!map.Erase(ids[0]), "erasing an id twice returned true");
+	wrong = 0;
+	for (int i = 0; i < idCount; i++) {
+		int expected = erased[i] ? ItemIdMap::kMissing : i % 2 == 0 ? idCount + i : i;
+		wrong += map.Find(ids[i]) != expected ? 1 : 0;
+	}
+	failures += check(wrong == 0, "an id was lost or kept after erasing its neighbours");
+	failures += check(map.Size() == (size_t)(idCount - (idCount + 2) / 3), "erasing changed the map size wrongly");
+
+	for (int i = 0; i < idCount; i += 3) {
+		map.Set(ids[i], i);
+	}
+	wrong = 0;
+	for (int i = 0; i < idCount; i++) {
+		int expected = i % 3 == 0 ? i : i % 2 == 0 ? idCount + i : i;
+		wrong += map.Find(ids[i]) != expected ? 1 : 0;
+	}
+	failures += check(wrong == 0, "an id did not round-trip after being erased and set again");
+
+	map.Clear();
+	failures += check(map.Size() == 0 && map.Find(ids[1]) == ItemIdMap::kMissing, "clearing left an id behind");
+	return failures;
+}
+
+/// Times UpdateItem and RemoveItem on a million items with scattered ids, in random order. The items live in a
+/// linear scan, whose updates and removes are O(1), so the times are mostly the id lookups.
+void benchmarkItemUpdates() {
+	const int itemCount = 1000000;
+	Vector3 worldCenter(0, 0, 0);
+	Vector3 worldSize(1000, 1000, 1000);
+	const int linearBackend = 4; // SPATIAL_BACKEND_LINEAR
+	int spaceId = AllocSpatialPartitionerWithBackend(worldCenter, worldSize, linearBackend);
+
+	std::default_random_engine generator;
+	std::uniform_real_distribution<float> position(-500, 500);
+	std::vector<int> ids(itemCount);
+	std::vector<Vector3> centers(itemCount);
+	std::vector<Vector3> extents(itemCount, Vector3(0.5f, 0.5f, 0.5f));
+	for (int i = 0; i < itemCount; i++) {
+		ids[i] = i * 1021 + 13;
+		centers[i] = Vector3(position(generator), position(generator), position(generator));
+	}
+	SpatialPartitionerBulkLoad(spaceId, ids.data(), centers.data(), extents.data(), itemCount);
+	std::shuffle(ids.begin(), ids.end(), generator);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < itemCount; i++) {
+		SpatialPartitionerUpdateItem(spaceId, ids[i], centers[i], extents[i]);
+	}
+	auto updated = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < itemCount; i++) {
+		SpatialPartitionerRemoveItem(spaceId, ids[i]);
+	}
+	auto removed = std::chrono::high_resolution_clock::now();
+
+	double updateNs = std::chrono::duration<double, std::nano>(updated - start).count() / itemCount;
+	double removeNs = std::chrono::duration<double, std::nano>(removed - updated).count() / itemCount;
+	std::cout << "UpdateItem: " << updateNs << " ns per item at " << itemCount << " items" << std::endl;
+	std::cout << "RemoveItem: " << removeNs << " ns per item" << std::endl;
+}
+
+/// Has as many threads as the epoch reclaimer has slots each hold a ReadGuard, and once they all do, nest a second
+/// one, as the Read exports do around the partitioner's own guard. Nested guards share their thread's slot, so
+/// the threads all finish instead of each waiting for a slot another one holds.
+int testNestedReadGuards() {
+	const int threadCount = 64;
+	// Static, so threads left waiting after a failure don't outlive them.
+	static std::atomic<int> holding(0);
+	static std::atomic<int> finished(0);
+	holding = 0;
+	finished = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; t++) {
+		threads.push_back(std::thread([]() {
+			EpochReclaimer::ReadGuard outer;
+			holding++;
+			while (holding < threadCount) {
+				std::this_thread::yield();
+			}
+			EpochReclaimer::ReadGuard nested;
+			finished++;
+		}));
+	}
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (finished < threadCount && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	bool allFinished = finished == threadCount;
+	for (size_t t = 0; t < threads.size(); t++) {
+		if (allFinished) {
+			threads[t].join();
+		}
+		else {
+			threads[t].detach();
+		}
+	}
+	return check(allFinished, "threads holding every reader slot deadlocked on nested guards");
+}
+
+/// Runs more readers at once than half the epoch reclaimer's 64 slots, while the main thread keeps moving the
+/// items and publishing them. Each Read query holds a single slot, so the readers all finish, and each sees every
+/// item of some published version.
+int testConcurrentReaders() {
+	const int readerCount = 48;
+	const int queriesPerReader = 2000;
+	const int itemCount = 64;
+	Vector3 worldCenter(0, 0, 0);
+	Vector3 worldSize(100, 100, 100);
+	Vector3 small(0.5f, 0.5f, 0.5f);
+	Vector3 everything(50, 50, 50);
+	int spaceId = AllocSpatialPartitioner(worldCenter, worldSize);
+	for (int i = 0; i < itemCount; i++) {
+		Vector3 center((float)(i % 8) * 10 - 35, (float)(i / 8) * 10 - 35, 0);
+		SpatialPartitionerAddItem(spaceId, i, center, small);
+	}
+	SpatialPartitionerPublish(spaceId);
+
+	std::atomic<int> wrongCounts(0);
+	std::atomic<int> finishedReaders(0);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < readerCount; r++) {
+		readers.push_back(std::thread([&]() {
+			int results[itemCount];
+			for (int q = 0; q < queriesPerReader; q++) {
+				int count = SpatialPartitionerReadIntersectedBy(spaceId, worldCenter, everything, results, itemCount);
+				if (count != itemCount) {
+					wrongCounts++;
+				}
+			}
+			finishedReaders++;
+		}));
+	}
+	std::default_random_engine generator;
+	std::uniform_real_distribution<float> position(-40, 40);
+	while (finishedReaders < readerCount) {
+		Vector3 center(position(generator), position(generator), position(generator));
+		SpatialPartitionerUpdateItem(spaceId, (int)(generator() % itemCount), center, small);
+		SpatialPartitionerPublish(spaceId);
+	}
+	for (size_t r = 0; r < readers.size(); r++) {
+		readers[r].join();
+	}
+	FreeSpatialPartitioner(spaceId);
+	return check(wrongCounts == 0, "a concurrent reader missed published items");
+}
+
+/// Checks the paged query cursors: results past the first page come through SpatialPartitionerNextPage until the
+/// cursor is -1, a change to the items invalidates an open cursor, and a released cursor is gone.
+int testPagedQueries() {
+	int failures = 0;
+	const int itemCount = 100;
+	const int pageSize = 16;
+	Vector3 worldCenter(0, 0, 0);
+	Vector3 worldSize(100, 100, 100);
+	Vector3 small(0.5f, 0.5f, 0.5f);
+	Vector3 everything(50, 50, 50);
+	int spaceId = AllocSpatialPartitioner(worldCenter, worldSize);
+	for (int i = 0; i < itemCount; i++) {
+		Vector3 center((float)(i % 10) * 8 - 36, (float)(i / 10) * 8 - 36, 0);
+		SpatialPartitionerAddItem(spaceId, i, center, small);
+	}
+
+	int page[pageSize];
+	int cursor = 0;
+	int totalCount = 0;
+	int count = SpatialPartitionerIntersectedByPaged(spaceId, Vector3(-36, -36, 0), small, page, pageSize, &cursor, &totalCount);
+	failures += check(count == 1 && totalCount == 1 && cursor == -1, "a query fitting one page left a cursor open");
+
+	count = SpatialPartitionerIntersectedByPaged(spaceId, worldCenter, everything, page, pageSize, &cursor, &totalCount);
+	failures += check(count == pageSize && totalCount == itemCount && cursor > 0, "a query past one page was not paged");
+	std::vector<int> all(page, page + count);
+	int pages = 1;
+	while (cursor > 0 && pages <= itemCount) {
+		count = SpatialPartitionerNextPage(spaceId, &cursor, page, pageSize);
+		if (count < 0) break;
+		all.insert(all.end(), page, page + count);
+		pages++;
+	}
+	failures += check(cursor == -1 && (int)all.size() == totalCount, "paging did not end after totalCount results");
+	std::sort(all.begin(), all.end());
+	bool everyItem = (int)all.size() == itemCount;
+	for (size_t i = 0; everyItem && i < all.size(); i++) {
+		everyItem = all[i] == (int)i;
+	}
+	failures += check(everyItem, "the pages did not hold every item once");
+
+	count = SpatialPartitionerContainedByPaged(spaceId, worldCenter, everything, page, pageSize, &cursor, &totalCount);
+	SpatialPartitionerUpdateItem(spaceId, 0, worldCenter, small);
+	count = SpatialPartitionerNextPage(spaceId, &cursor, page, pageSize);
+	failures += check(count == -1 && cursor == 0, "a cursor stayed valid after the items changed");
+
+	count = SpatialPartitionerIntersectedByPaged(spaceId, worldCenter, everything, page, pageSize, &cursor, &totalCount);
+	SpatialPartitionerReleaseCursor(spaceId, cursor);
+	count = SpatialPartitionerNextPage(spaceId, &cursor, page, pageSize);
+	failures += check(count == -1 && cursor == 0, "a released cursor still returned results");
+
+	FreeSpatialPartitioner(spaceId);
+	return failures;
+}
+
+/// An item's bounds as the tests keep them, to check query results against.
+struct TestItem {
+	Vector3 center;
+	Vector3 extents;
+};
+
+/// Returns whether the box of center and extents holds all of item, or with contained false, overlaps it.
+bool testBoxMatches(const Vector3& center, const Vector3& extents, const TestItem& item, bool contained) {
+	float boxMin[3] = { center.x - extents.x, center.y - extents.y, center.z - extents.z };
+	float boxMax[3] = { center.x + extents.x, center.y + extents.y, center.z + extents.z };
+	float itemMin[3] = { item.center.x - item.extents.x, item.center.y - item.extents.y, item.center.z - item.extents.z };
+	float itemMax[3] = { item.center.x + item.extents.x, item.center.y + item.extents.y, item.center.z + item.extents.z };
+	for (int axis = 0; axis < 3; axis++) {
+		if (contained ? boxMin[axis] > itemMin[axis] || boxMax[axis] < itemMax[axis]
+			: boxMax[axis] < itemMin[axis] || boxMin[axis] > itemMax[axis]) return false;
+	}
+	return true;
+}
+
+/// Runs random adds, updates, removes and bulk loads on the partitioner behind spaceId, and checks after every few
+/// that SpatialPartitionerContainedBy and SpatialPartitionerIntersectedBy find the same items as a scan of the bounds
+/// the test kept, and that SpatialPartitionerIntersectedByOrig agrees. Returns the number of failed checks.
+int testBackendOperations(int spaceId, const char* name, unsigned seed) {
+	const int operationCount = 3000;
+	const int maxResults = 2048;
+	std::default_random_engine generator(seed);
+	std::uniform_real_distribution<float> position(-45, 45);
+	std::uniform_real_distribution<float> size(0.1f, 3);
+	std::uniform_real_distribution<float> querySize(1, 30);
+	std::map<int, TestItem> items;
+	int nextId = 0;
+	auto randomItem = [&]() {
+		TestItem item = { Vector3(position(generator), position(generator), position(generator)),
+			Vector3(size(generator), size(generator), size(generator)) };
+		return item;
+	};
+	auto randomId = [&]() {
+		auto it = items.begin();
+		std::advance(it, generator() % items.size());
+		return it->first;
+	};
+
+	int wrongQueries = 0;
+	std::vector<int> results(maxResults);
+	std::vector<int> reference(maxResults);
+	std::vector<int> expected;
+	for (int op = 0; op < operationCount; op++) {
+		int kind = (int)(generator() % 20);
+		if (items.empty() || kind < 6) {
+			TestItem item = randomItem();
+			SpatialPartitionerAddItem(spaceId, nextId, item.center, item.extents);
+			items[nextId++] = item;
+		}
+		else if (kind < 14) {
+			int id = randomId();
+			TestItem item = randomItem();
+			SpatialPartitionerUpdateItem(spaceId, id, item.center, item.extents);
+			items[id] = item;
+		}
+		else if (kind < 19) {
+			int id = randomId();
+			SpatialPartitionerRemoveItem(spaceId, id);
+			items.erase(id);
+		}
+		else {
+			// Half the batch updates present items, the rest adds new ones.
+			std::vector<int> ids;
+			std::vector<Vector3> centers;
+			std::vector<Vector3> extents;
+			for (int i = 0; i < 20; i++) {
+				int id = i % 2 == 0 ? randomId() : nextId++;
+				TestItem item = randomItem();
+				ids.push_back(id);
+				centers.push_back(item.center);
+				extents.push_back(item.extents);
+				items[id] = item;
+			}
+			SpatialPartitionerBulkLoad(spaceId, ids.data(), centers.data(), extents.data(), (int)ids.size());
+		}
+
+		if (op % 7 != 0) continue;
+		Vector3 center(position(generator), position(generator), position(generator));
+		Vector3 extents(querySize(generator), querySize(generator), querySize(generator));
+		for (int contained = 0; contained < 2; contained++) {
+			expected.clear();
+			for (auto it = items.begin(); it != items.end(); ++it) {
+				if (testBoxMatches(center, extents, it->second, contained != 0)) {
+					expected.push_back(it->first);
+				}
+			}
+			int count = contained ? SpatialPartitionerContainedBy(spaceId, center, extents, results.data(), maxResults)
+				: SpatialPartitionerIntersectedBy(spaceId, center, extents, results.data(), maxResults);
+			std::sort(results.begin(), results.begin() + count);
+			if (count != (int)expected.size() || !std::equal(expected.begin(), expected.end(), results.begin())) {
+				wrongQueries++;
+			}
+			if (!contained) {
+				int referenceCount = SpatialPartitionerIntersectedByOrig(spaceId, center, extents, reference.data(), maxResults);
+				std::sort(reference.begin(), reference.begin() + referenceCount);
+				if (referenceCount != count || !std::equal(reference.begin(), reference.begin() + count, results.begin())) {
+					wrongQueries++;
+				}
+			}
+		}
+	}
+	if (wrongQueries > 0) {
+		std::cout << name << ": " << wrongQueries << " queries disagreed with the reference scan" << std::endl;
+	}
+	return check(wrongQueries == 0, "a backend's query results differed from the reference scan");
+}
+
+/// Checks every backend against the reference scan under the same random workload, including the octree with its
+/// own depth and looseness. The automatic backend starts empty on a linear scan and has to move once it grows
+/// past what a linear scan holds.
+int testBackends() {
+	int failures = 0;
+	Vector3 worldCenter(0, 0, 0);
+	Vector3 worldSize(100, 100, 100);
+	const char* names[] = { "BVH", "octree", "sweep and prune", "hashed grid", "linear scan", "automatic", "quantized scan" };
+	for (int backend = SPATIAL_BACKEND_BVH; backend <= SPATIAL_BACKEND_QUANTIZED; backend++) {
+		int spaceId = AllocSpatialPartitionerWithBackend(worldCenter, worldSize, backend);
+		failures += testBackendOperations(spaceId, names[backend], 1000 + backend);
+		if (backend == SPATIAL_BACKEND_AUTO) {
+			failures += check(SpatialPartitionerGetBackend(spaceId) != SPATIAL_BACKEND_LINEAR, "the automatic backend never left the linear scan");
+		}
+		FreeSpatialPartitioner(spaceId);
+	}
+	int octreeId = AllocSpatialPartitionerOctree(worldCenter, worldSize, 4, 2.0f);
+	failures += testBackendOperations(octreeId, "octree of depth 4", 2000);
+	FreeSpatialPartitioner(octreeId);
+	return failures;
+}
+
+/// Returns the ids a snapshot, or with snapshot false a partitioner, finds intersecting a box, sorted.
+std::vector<int> testSortedHits(int handle, bool snapshot, Vector3 center, Vector3 extents) {
+	std::vector<int> hits(1024);
+	int count = snapshot ? SpatialSnapshotIntersectedBy(handle, center, extents, hits.data(), (int)hits.size())
+		: SpatialPartitionerIntersectedBy(handle, center, extents, hits.data(), (int)hits.size());
+	hits.resize(count);
+	std::sort(hits.begin(), hits.end());
+	return hits;
+}
+
+/// Checks that a snapshot keeps answering with the items it was taken of while the partitioner's items move, go
+/// and come, and that freed snapshot handles are safe to query and to free again.
+int testSnapshots() {
+	int failures = 0;
+	const int itemCount = 300;
+	Vector3 worldCenter(0, 0, 0);
+	Vector3 worldSize(100, 100, 100);
+	Vector3 small(0.5f, 0.5f, 0.5f);
+	Vector3 everything(50, 50, 50);
+	Vector3 leftHalf(-25, 0, 0);
+	Vector3 halfExtents(25, 50, 50);
+	int spaceId = AllocSpatialPartitioner(worldCenter, worldSize);
+	for (int i = 0; i < itemCount; i++) {
+		Vector3 center((float)(i % 20) * 4 - 38, (float)(i / 20) * 4 - 38, 0);
+		SpatialPartitionerAddItem(spaceId, i, center, small);
+	}
+
+	int snapshotId = SpatialPartitionerSnapshot(spaceId);
+	std::vector<int> frozen = testSortedHits(spaceId, false, leftHalf, halfExtents);
+	failures += check(SpatialSnapshotItemCount(snapshotId) == itemCount, "a snapshot did not hold every item");
+	failures += check(testSortedHits(snapshotId, true, leftHalf, halfExtents) == frozen, "a snapshot disagreed with the items it was taken of");
+
+	// Move the first 50 items to the other half, remove the next 20 and add 30 new ones.
+	for (int i = 0; i < 50; i++) {
+		SpatialPartitionerUpdateItem(spaceId, i, Vector3(30, (float)i - 25, 10), small);
+	}
+	for (int i = 50; i < 70; i++) {
+		SpatialPartitionerRemoveItem(spaceId, i);
+	}
+	for (int i = 0; i < 30; i++) {
+		SpatialPartitionerAddItem(spaceId, itemCount + i, Vector3(-30, (float)i - 15, -10), small);
+	}
+	SpatialPartitionerPublish(spaceId);
+	failures += check(testSortedHits(spaceId, false, leftHalf, halfExtents) != frozen, "the changes did not reach the partitioner");
+	failures += check(SpatialSnapshotItemCount(snapshotId) == itemCount, "a snapshot's item count followed later changes");
+	failures += check(testSortedHits(snapshotId, true, leftHalf, halfExtents) == frozen, "a snapshot's results followed later changes");
+
+	int laterId = SpatialPartitionerSnapshot(spaceId);
+	std::vector<int> later = testSortedHits(spaceId, false, leftHalf, halfExtents);
+	failures += check(SpatialSnapshotItemCount(laterId) == itemCount + 10, "a later snapshot missed the changes");
+	failures += check(testSortedHits(laterId, true, leftHalf, halfExtents) == later, "a later snapshot disagreed with the items");
+
+	int results[16];
+	FreeSpatialSnapshot(snapshotId);
+	failures += check(SpatialSnapshotItemCount(snapshotId) == 0 && SpatialSnapshotGetVersion(snapshotId) == -1
+		&& SpatialSnapshotIntersectedBy(snapshotId, worldCenter, everything, results, 16) == 0, "a freed snapshot still answered");
+	FreeSpatialSnapshot(snapshotId);
+	failures += check(testSortedHits(laterId, true, leftHalf, halfExtents) == later, "freeing a snapshot twice disturbed another");
+
+	// A snapshot outlives its partitioner.
+	FreeSpatialPartitioner(spaceId);
+	failures += check(testSortedHits(laterId, true, leftHalf, halfExtents) == later, "a snapshot changed when its partitioner was freed");
+	FreeSpatialSnapshot(laterId);
+	return failures;
+}
+
+/// Checks that in deferred mode the queued changes to an item collapse to its final state: several updates, then
+/// a remove, then a re-add of the same id leave only the re-added item, for the next query and for an explicit
+/// SpatialPartitionerFlushUpdates alike.
+int testDeferredUpdates() {
+	int failures = 0;
+	Vector3 worldCenter(0, 0, 0);
+	Vector3 worldSize(100, 100, 100);
+	Vector3 small(0.5f, 0.5f, 0.5f);
+	Vector3 everything(50, 50, 50);
+	Vector3 start(-20, 0, 0);
+	Vector3 first(-10, 0, 0);
+	Vector3 second(0, 0, 0);
+	Vector3 readded(10, 0, 0);
+	Vector3 flushed(20, 0, 0);
+	int results[16];
+	int spaceId = AllocSpatialPartitioner(worldCenter, worldSize);
+	SpatialPartitionerAddItem(spaceId, 7, start, small);
+	SpatialPartitionerAddItem(spaceId, 8, Vector3(0, 20, 0), small);
+	SpatialPartitionerSetDeferredUpdates(spaceId, 1);
+
+	SpatialPartitionerUpdateItem(spaceId, 7, first, small);
+	SpatialPartitionerUpdateItem(spaceId, 7, second, small);
+	SpatialPartitionerRemoveItem(spaceId, 7);
+	SpatialPartitionerAddItem(spaceId, 7, readded, small);
+	// An item added and removed again while queued never appears.
+	SpatialPartitionerAddItem(spaceId, 9, start, small);
+	SpatialPartitionerRemoveItem(spaceId, 9);
+
+	int count = SpatialPartitionerIntersectedBy(spaceId, readded, small, results, 16);
+	failures += check(count == 1 && results[0] == 7, "the next query missed the re-added item");
+	bool leftBehind = false;
+	Vector3 earlier[] = { start, first, second };
+	for (int i = 0; i < 3; i++) {
+		leftBehind = leftBehind || SpatialPartitionerIntersectedBy(spaceId, earlier[i], small, results, 16) != 0;
+	}
+	failures += check(!leftBehind, "a queued update or removed item showed up after the re-add");
+	failures += check(SpatialPartitionerIntersectedBy(spaceId, worldCenter, everything, results, 16) == 2, "deferred changes left the wrong number of items");
+
+	SpatialPartitionerUpdateItem(spaceId, 7, first, small);
+	SpatialPartitionerUpdateItem(spaceId, 7, flushed, small);
+	SpatialPartitionerFlushUpdates(spaceId);
+	count = SpatialPartitionerIntersectedBy(spaceId, flushed, small, results, 16);
+	failures += check(count == 1 && results[0] == 7, "flushing did not apply the last queued update");
+	failures += check(SpatialPartitionerIntersectedBy(spaceId, first, small, results, 16) == 0
+		&& SpatialPartitionerIntersectedBy(spaceId, readded, small, results, 16) == 0, "flushing kept an earlier position");
 
+	FreeSpatialPartitioner(spaceId);
+	return failures;
 }
 
 void generatedTest() {
@@ -0,0 +1,73 @@
+#pragma once
+#include "libAssImp\VectorTypes.h"
+#include <cstdint>
+#include <xmmintrin.h> //SSE
+#include <emmintrin.h> //SSE2
+
+struct AABB {
+
+	__m128 vecmax;
+	__m128 vecmin;
+
+	AABB(int32_t id, Vector3 center, Vector3 extents) {
+		__m128 v_center = _mm_set_ps(reinterpret_cast<float &>(id), center.z, center.y, center.x);
+		__m128 v_extents = _mm_set_ps(0, extents.z, extents.y, extents.x);
+		vecmin = _mm_sub_ps(v_center, v_extents);
+		vecmax = _mm_add_ps(v_center, v_extents);
+	};
+
+	AABB() {};
+	AABB& operator=(const AABB& other) {
+		vecmax = other.vecmax;
+		vecmin = other.vecmin;
+		return *this;
+	}
+};
+
+inline bool intersects(const AABB &volume0, const AABB &volume1) {
+	/* This is an implementation of AABB intersection using SSE/SSE2 SIMD instructions.
+	This is the non-SIMD code for what it is implementing:
+	if (volume0.max.x < volume1.min.x || volume0.min.x > volume1.max.x) return 0;
+	if (volume0.max.y < volume1.min.y || volume0.min.y > volume1.max.y) return 0;
+	if (volume0.max.z < volume1.min.z || volume0.min.z > volume1.max.z) return 0;
+	return 1;*/
+	__m128 temp = _mm_cmplt_ps(volume0.vecmax, volume1.vecmin);
+	__m128 temp2 = _mm_cmpgt_ps(volume0.vecmin, volume1.vecmax);
+	temp = _mm_or_ps(temp, temp2);
+	return (_mm_movemask_ps(temp) & 7) <= 0;
+
+}
+
+inline int contains(const AABB &volume0, const AABB &volume1) {
+	// SSE implementation of the below scalar check.
+	// Checks whether the volume1 AABB is completely contained within the volume0 AABB.
+	/*if (volume0.min.x > volume1.min.x || volume0.max.x < volume1.max.x) return 0;
+	if (volume0.min.y > volume1.min.y || volume0.max.y < volume1.max.y) return 0;
+	if (volume0.min.z > volume1.min.z || volume0.max.z < volume1.max.z) return 0;*/
+	__m128 temp = _mm_cmpgt_ps(volume0.vecmin, volume1.vecmin);
+	__m128 temp2 = _mm_cmplt_ps(volume0.vecmax, volume1.vecmax);
+	temp = _mm_or_ps(temp, temp2);
+	return (_mm_movemask_ps(temp) & 7) <= 0;
+}
+
+/// Extracts the integer id from the component of the float vector that its bits are stored in.
+/// Implemented via magic.
+inline int32_t IdFromAABB(const AABB& box) {
+	__m128 temp = _mm_shuffle_ps(box.vecmax, box.vecmax, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_cvtsi128_si32(_mm_castps_si128(temp));
+}
+
+/// Returns the smallest AABB enclosing both volumes. The w lane of the result carries no id.
+inline AABB Union(const AABB &volume0, const AABB &volume1) {
+	AABB result;
+	result.vecmin = _mm_min_ps(volume0.vecmin, volume1.vecmin);
+	result.vecmax = _mm_max_ps(volume0.vecmax, volume1.vecmax);
+	return result;
+}
+
+/// Returns half the surface area of the volume, which is all the tree cost heuristics need.
+inline float HalfSurfaceArea(const AABB &volume) {
+	float size[4];
+	_mm_storeu_ps(size, _mm_sub_ps(volume.vecmax, volume.vecmin));
+	return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
@@ -0,0 +1,80 @@
+#include "AABBArray.h"
+
+void AABBArray::Reserve(size_t count) {
+	minX.reserve(count);
+	minY.reserve(count);
+	minZ.reserve(count);
+	maxX.reserve(count);
+	maxY.reserve(count);
+	maxZ.reserve(count);
+	ids.reserve(count);
+};
+
+/// Appends bounds for itemId.
+void AABBArray::Push(int itemId, const AABB& bounds) {
+	float boundsMin[4];
+	float boundsMax[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	_mm_storeu_ps(boundsMax, bounds.vecmax);
+	minX.push_back(boundsMin[0]);
+	minY.push_back(boundsMin[1]);
+	minZ.push_back(boundsMin[2]);
+	maxX.push_back(boundsMax[0]);
+	maxY.push_back(boundsMax[1]);
+	maxZ.push_back(boundsMax[2]);
+	ids.push_back(itemId);
+};
+
+/// Overwrites the bounds at position i.
+void AABBArray::Set(size_t i, const AABB& bounds) {
+	float boundsMin[4];
+	float boundsMax[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	_mm_storeu_ps(boundsMax, bounds.vecmax);
+	minX[i] = boundsMin[0];
+	minY[i] = boundsMin[1];
+	minZ[i] = boundsMin[2];
+	maxX[i] = boundsMax[0];
+	maxY[i] = boundsMax[1];
+	maxZ[i] = boundsMax[2];
+};
+
+/// Returns the bounds at position i, with the item's id in the id lane.
+AABB AABBArray::Get(size_t i) const {
+	float id = reinterpret_cast<const float&>(ids[i]);
+	AABB bounds;
+	bounds.vecmin = _mm_set_ps(id, minZ[i], minY[i], minX[i]);
+	bounds.vecmax = _mm_set_ps(id, maxZ[i], maxY[i], maxX[i]);
+	return bounds;
+};
+
+/// Copies the item at position from over the item at position to.
+void AABBArray::Move(size_t to, size_t from) {
+	minX[to] = minX[from];
+	minY[to] = minY[from];
+	minZ[to] = minZ[from];
+	maxX[to] = maxX[from];
+	maxY[to] = maxY[from];
+	maxZ[to] = maxZ[from];
+	ids[to] = ids[from];
+};
+
+void AABBArray::PopBack() {
+	minX.pop_back();
+	minY.pop_back();
+	minZ.pop_back();
+	maxX.pop_back();
+	maxY.pop_back();
+	maxZ.pop_back();
+	ids.pop_back();
+};
+
+void AABBArray::Clear() {
+	minX.clear();
+	minY.clear();
+	minZ.clear();
+	maxX.clear();
+	maxY.clear();
+	maxZ.clear();
+	ids.clear();
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include "AABB.h"
+#include <vector>
+
+/// Item bounds stored as a structure of arrays, one array per bound plus one of item ids, so the scan kernels
+/// can test a full vector register's worth of items per iteration.
+struct AABBArray {
+	std::vector<float> minX;
+	std::vector<float> minY;
+	std::vector<float> minZ;
+	std::vector<float> maxX;
+	std::vector<float> maxY;
+	std::vector<float> maxZ;
+	std::vector<int> ids;
+
+	size_t Size() const {
+		return ids.size();
+	}
+
+	void Reserve(size_t count);
+
+	/// Appends bounds for itemId.
+	void Push(int itemId, const AABB& bounds);
+
+	/// Overwrites the bounds at position i.
+	void Set(size_t i, const AABB& bounds);
+
+	/// Returns the bounds at position i, with the item's id in the id lane.
+	AABB Get(size_t i) const;
+
+	/// Copies the item at position from over the item at position to.
+	void Move(size_t to, size_t from);
+
+	void PopBack();
+	void Clear();
+};
@@ -0,0 +1,737 @@
+#include "DynamicAABBTree.h"
+#include <algorithm>
+
+static const int kNullNode = -1;
+
+/// Leaves are enlarged by this fraction of their size on each side, so an item dragged by less than that
+/// only updates its exact bounds.
+static const float kFatMarginRatio = 0.1f;
+
+/// A leaf whose enlarged bounds have grown this much larger than a freshly enlarged box is reinserted, so
+/// items that shrink don't keep a stale oversized box in the tree.
+static const float kMaxFatAreaRatio = 4.0f;
+
+/// Number of bins the centroid range of a node is divided into when searching for its best split during a build.
+static const int kBuildBins = 16;
+
+namespace {
+	/// Depth-first traversal stack that stays on the C++ stack for any reasonably balanced tree, and only
+	/// spills to the heap for degenerate ones.
+	class TraversalStack {
+	public:
+		TraversalStack() : count(0) {};
+
+		void Push(int node) {
+			if (count < kInlineCapacity) {
+				inlineNodes[count] = node;
+			}
+			else {
+				overflow.push_back(node);
+			}
+			count++;
+		}
+
+		int Pop() {
+			count--;
+			if (count < kInlineCapacity) {
+				return inlineNodes[count];
+			}
+			int node = overflow.back();
+			overflow.pop_back();
+			return node;
+		}
+
+		bool Empty() const {
+			return count == 0;
+		}
+
+	private:
+		static const int kInlineCapacity = 64;
+		int inlineNodes[kInlineCapacity];
+		std::vector<int> overflow;
+		int count;
+	};
+
+	/// A leaf taking part in a build. Its bounds are copied in so the build sweeps contiguous memory.
+	struct BuildLeaf {
+		AABB bounds;
+		float centroid[3];
+		int node;
+	};
+
+	/// A run of build leaves that still needs a subtree, and where to attach it.
+	struct BuildRange {
+		int begin;
+		int end;
+		int parent;
+		bool firstChild;
+	};
+
+	/// A node waiting in the queue of a nearest-first traversal, with the visitor's distance to its bounds.
+	struct NearestEntry {
+		float distance;
+		int node;
+	};
+
+	/// Heap order that keeps the closest queued node on top.
+	bool Farther(const NearestEntry& a, const NearestEntry& b) {
+		return a.distance > b.distance;
+	}
+}
+
+/// Enlarges bounds by kFatMarginRatio of their size on each side.
+static AABB Fatten(const AABB& bounds) {
+	__m128 margin = _mm_mul_ps(_mm_sub_ps(bounds.vecmax, bounds.vecmin), _mm_set1_ps(kFatMarginRatio));
+	AABB fat;
+	fat.vecmin = _mm_sub_ps(bounds.vecmin, margin);
+	fat.vecmax = _mm_add_ps(bounds.vecmax, margin);
+	return fat;
+}
+
+/// Partitions leaves[begin, end) along the axis with the widest centroid spread, at the split between bins
+/// that minimizes the surface area cost of the two halves, and returns where the second half starts.
+static int SplitRange(std::vector<BuildLeaf>& leaves, int begin, int end) {
+	float centroidMin[3];
+	float centroidMax[3];
+	for (int axis = 0; axis < 3; axis++) {
+		centroidMin[axis] = leaves[begin].centroid[axis];
+		centroidMax[axis] = leaves[begin].centroid[axis];
+	}
+	for (int i = begin + 1; i < end; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			centroidMin[axis] = std::min(centroidMin[axis], leaves[i].centroid[axis]);
+			centroidMax[axis] = std::max(centroidMax[axis], leaves[i].centroid[axis]);
+		}
+	}
+	int axis = 0;
+	for (int a = 1; a < 3; a++) {
+		if (centroidMax[a] - centroidMin[a] > centroidMax[axis] - centroidMin[axis]) {
+			axis = a;
+		}
+	}
+
+	// Leaves with coincident centroids can't be told apart, so they are split evenly.
+	int middle = begin + (end - begin) / 2;
+	float extent = centroidMax[axis] - centroidMin[axis];
+	if (!(extent > 0)) return middle;
+
+	float scale = kBuildBins / extent;
+	float offset = centroidMin[axis];
+	auto binOf = [=](const BuildLeaf& leaf) {
+		return std::min((int)((leaf.centroid[axis] - offset) * scale), kBuildBins - 1);
+	};
+
+	int binCount[kBuildBins] = {};
+	AABB binBounds[kBuildBins];
+	for (int i = begin; i < end; i++) {
+		int bin = binOf(leaves[i]);
+		binBounds[bin] = binCount[bin] == 0 ? leaves[i].bounds : Union(binBounds[bin], leaves[i].bounds);
+		binCount[bin]++;
+	}
+
+	// Sweep from the right to get the cost of every right half, then from the left to find the cheapest split.
+	float rightCost[kBuildBins];
+	int rightCount[kBuildBins];
+	AABB accumulated;
+	int accumulatedCount = 0;
+	for (int bin = kBuildBins - 1; bin > 0; bin--) {
+		if (binCount[bin] > 0) {
+			accumulated = accumulatedCount == 0 ? binBounds[bin] : Union(accumulated, binBounds[bin]);
+			accumulatedCount += binCount[bin];
+		}
+		rightCount[bin] = accumulatedCount;
+		rightCost[bin] = accumulatedCount == 0 ? 0 : HalfSurfaceArea(accumulated) * accumulatedCount;
+	}
+	int bestSplit = -1;
+	float bestCost = 0;
+	accumulatedCount = 0;
+	for (int bin = 0; bin < kBuildBins - 1; bin++) {
+		if (binCount[bin] > 0) {
+			accumulated = accumulatedCount == 0 ? binBounds[bin] : Union(accumulated, binBounds[bin]);
+			accumulatedCount += binCount[bin];
+		}
+		if (accumulatedCount == 0 || rightCount[bin + 1] == 0) continue;
+		float cost = HalfSurfaceArea(accumulated) * accumulatedCount + rightCost[bin + 1];
+		if (bestSplit < 0 || cost < bestCost) {
+			bestSplit = bin + 1;
+			bestCost = cost;
+		}
+	}
+	if (bestSplit < 0) return middle;
+
+	std::vector<BuildLeaf>::iterator second = std::partition(leaves.begin() + begin, leaves.begin() + end,
+		[&](const BuildLeaf& leaf) { return binOf(leaf) < bestSplit; });
+	return (int)(second - leaves.begin());
+}
+
+DynamicAABBTree::DynamicAABBTree() : root(kNullNode), freeList(kNullNode), leafCount(0), refitStamp(0) {
+
+};
+
+int DynamicAABBTree::AllocateNode() {
+	int node;
+	if (freeList != kNullNode) {
+		node = freeList;
+		freeList = nodes[node].parent;
+	}
+	else {
+		node = (int)nodes.size();
+		nodes.push_back(TreeNode());
+	}
+	TreeNode& treeNode = nodes[node];
+	treeNode.parent = kNullNode;
+	treeNode.child1 = kNullNode;
+	treeNode.child2 = kNullNode;
+	treeNode.height = 0;
+	treeNode.itemId = -1;
+	return node;
+};
+
+void DynamicAABBTree::FreeNode(int node) {
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+};
+
+/// Inserts an item with the given bounds and returns a proxy that stays valid until the item is removed.
+int DynamicAABBTree::Insert(int itemId, const AABB& bounds) {
+	int leaf = AllocateNode();
+	nodes[leaf].itemId = itemId;
+	nodes[leaf].itemBounds = bounds;
+	nodes[leaf].bounds = Fatten(bounds);
+	InsertLeaf(leaf);
+	leafCount++;
+	return leaf;
+};
+
+/// Inserts count items at once. When the batch is at least as large as the tree, the whole tree is rebuilt
+/// top down over the old and new leaves, which is both faster and gives a better tree than inserting the
+/// items one at a time. Existing proxies stay valid, since only internal nodes are replaced.
+void DynamicAABBTree::InsertMany(const AABB* bounds, int count, int* proxies) {
+	if (count < leafCount) {
+		SpatialIndex::InsertMany(bounds, count, proxies);
+		return;
+	}
+
+	std::vector<int> leaves;
+	leaves.reserve(leafCount + count);
+	ReleaseInternalNodes(leaves);
+
+	nodes.reserve(nodes.size() + 2 * count);
+	for (int i = 0; i < count; i++) {
+		int leaf = AllocateNode();
+		nodes[leaf].itemId = IdFromAABB(bounds[i]);
+		nodes[leaf].itemBounds = bounds[i];
+		nodes[leaf].bounds = Fatten(bounds[i]);
+		proxies[i] = leaf;
+		leaves.push_back(leaf);
+	}
+	leafCount += count;
+	root = Build(leaves);
+};
+
+/// Moves the item behind proxy to new bounds. The tree is only restructured if the item left its enlarged box.
+void DynamicAABBTree::Update(int proxy, const AABB& bounds) {
+	TreeNode& leaf = nodes[proxy];
+	leaf.itemBounds = bounds;
+	AABB fat = Fatten(bounds);
+	if (contains(leaf.bounds, bounds) && HalfSurfaceArea(leaf.bounds) <= kMaxFatAreaRatio * HalfSurfaceArea(fat)) {
+		return;
+	}
+	RemoveLeaf(proxy);
+	nodes[proxy].bounds = fat;
+	InsertLeaf(proxy);
+};
+
+/// Removes the item behind proxy.
+void DynamicAABBTree::Remove(int proxy) {
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	leafCount--;
+};
+
+/// Moves count items at once. Leaves that left their enlarged box take a new one in place, and their ancestors
+/// are refitted in a single pass, each once, rather than removing and reinserting every leaf. Refitting keeps
+/// the structure of the tree, which suits a group of items moved together. When at least half the leaves
+/// moved, the tree is rebuilt over them instead.
+void DynamicAABBTree::UpdateMany(const int* proxies, const AABB* bounds, int count) {
+	std::vector<int> moved;
+	for (int i = 0; i < count; i++) {
+		TreeNode& leaf = nodes[proxies[i]];
+		leaf.itemBounds = bounds[i];
+		AABB fat = Fatten(bounds[i]);
+		if (contains(leaf.bounds, bounds[i]) && HalfSurfaceArea(leaf.bounds) <= kMaxFatAreaRatio * HalfSurfaceArea(fat)) {
+			continue;
+		}
+		leaf.bounds = fat;
+		moved.push_back(proxies[i]);
+	}
+	if (moved.empty()) return;
+
+	if (2 * (int)moved.size() >= leafCount) {
+		std::vector<int> leaves;
+		leaves.reserve(leafCount);
+		ReleaseInternalNodes(leaves);
+		root = Build(leaves);
+		return;
+	}
+
+	// Gather each ancestor once, stamping it so the walk from the next leaf stops there, and bucket them by
+	// height. Refitting leaves heights alone, so going up the buckets refits every node after its children.
+	refitStamp++;
+	if (refitStamp == 0) {
+		std::fill(refitStamps.begin(), refitStamps.end(), 0);
+		refitStamp = 1;
+	}
+	refitStamps.resize(nodes.size(), 0);
+	std::vector<std::vector<int> > levels(nodes[root].height + 1);
+	for (size_t i = 0; i < moved.size(); i++) {
+		for (int index = nodes[moved[i]].parent; index != kNullNode && refitStamps[index] != refitStamp; index = nodes[index].parent) {
+			refitStamps[index] = refitStamp;
+			levels[nodes[index].height].push_back(index);
+		}
+	}
+	for (size_t level = 0; level < levels.size(); level++) {
+		for (size_t i = 0; i < levels[level].size(); i++) {
+			TreeNode& treeNode = nodes[levels[level][i]];
+			treeNode.bounds = Union(nodes[treeNode.child1].bounds, nodes[treeNode.child2].bounds);
+		}
+	}
+};
+
+/// Removes count items at once. When at least half the leaves go, the tree is rebuilt over the rest, rather
+/// than unlinking the leaves one by one.
+void DynamicAABBTree::RemoveMany(const int* proxies, int count) {
+	if (2 * count < leafCount) {
+		SpatialIndex::RemoveMany(proxies, count);
+		return;
+	}
+
+	std::vector<int> leaves;
+	leaves.reserve(leafCount);
+	ReleaseInternalNodes(leaves);
+	for (int i = 0; i < count; i++) {
+		FreeNode(proxies[i]);
+	}
+	leaves.erase(std::remove_if(leaves.begin(), leaves.end(), [&](int leaf) { return nodes[leaf].height < 0; }), leaves.end());
+	leafCount -= count;
+	root = Build(leaves);
+};
+
+/// Removes all items.
+void DynamicAABBTree::Clear() {
+	nodes.clear();
+	refitStamps.clear();
+	root = kNullNode;
+	freeList = kNullNode;
+	leafCount = 0;
+};
+
+/// Returns the height of the tree, or -1 if it is empty.
+int DynamicAABBTree::GetHeight() const {
+	return root == kNullNode ? -1 : nodes[root].height;
+};
+
+void DynamicAABBTree::InsertLeaf(int leaf) {
+	if (root == kNullNode) {
+		root = leaf;
+		nodes[leaf].parent = kNullNode;
+		return;
+	}
+
+	// Walk down the tree, choosing at each level whichever of creating a new parent here or descending into
+	// a child adds the least surface area. Every ancestor grows to enclose the leaf, which is the inherited cost.
+	AABB leafBounds = nodes[leaf].bounds;
+	int index = root;
+	while (!nodes[index].IsLeaf()) {
+		const TreeNode& node = nodes[index];
+		float area = HalfSurfaceArea(node.bounds);
+		float combinedArea = HalfSurfaceArea(Union(node.bounds, leafBounds));
+		float cost = 2.0f * combinedArea;
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		const TreeNode& child1 = nodes[node.child1];
+		float cost1 = HalfSurfaceArea(Union(leafBounds, child1.bounds)) + inheritanceCost;
+		if (!child1.IsLeaf()) {
+			cost1 -= HalfSurfaceArea(child1.bounds);
+		}
+		const TreeNode& child2 = nodes[node.child2];
+		float cost2 = HalfSurfaceArea(Union(leafBounds, child2.bounds)) + inheritanceCost;
+		if (!child2.IsLeaf()) {
+			cost2 -= HalfSurfaceArea(child2.bounds);
+		}
+
+		if (cost < cost1 && cost < cost2) break;
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	// Pair the leaf with the chosen sibling under a new parent. AllocateNode may grow the node vector, so
+	// nothing above holds a reference across it.
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].bounds = Union(leafBounds, nodes[sibling].bounds);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != kNullNode) {
+		if (nodes[oldParent].child1 == sibling) {
+			nodes[oldParent].child1 = newParent;
+		}
+		else {
+			nodes[oldParent].child2 = newParent;
+		}
+	}
+	else {
+		root = newParent;
+	}
+
+	RefitAncestors(oldParent);
+};
+
+void DynamicAABBTree::RemoveLeaf(int leaf) {
+	if (leaf == root) {
+		root = kNullNode;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	// The sibling takes the place of the parent, which is no longer needed.
+	if (grandParent != kNullNode) {
+		if (nodes[grandParent].child1 == parent) {
+			nodes[grandParent].child1 = sibling;
+		}
+		else {
+			nodes[grandParent].child2 = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		FreeNode(parent);
+		RefitAncestors(grandParent);
+	}
+	else {
+		root = sibling;
+		nodes[sibling].parent = kNullNode;
+		FreeNode(parent);
+	}
+};
+
+/// Refits bounds and heights from node up to the root, rebalancing on the way.
+void DynamicAABBTree::RefitAncestors(int node) {
+	int index = node;
+	while (index != kNullNode) {
+		index = Balance(index);
+		TreeNode& treeNode = nodes[index];
+		const TreeNode& child1 = nodes[treeNode.child1];
+		const TreeNode& child2 = nodes[treeNode.child2];
+		treeNode.height = 1 + std::max(child1.height, child2.height);
+		treeNode.bounds = Union(child1.bounds, child2.bounds);
+		index = treeNode.parent;
+	}
+};
+
+/// Builds a tree over the given leaves top down, splitting at the binned surface area optimum, and returns its root.
+int DynamicAABBTree::Build(const std::vector<int>& leaves) {
+	if (leaves.empty()) return kNullNode;
+
+	std::vector<BuildLeaf> buildLeaves(leaves.size());
+	for (size_t i = 0; i < leaves.size(); i++) {
+		const AABB& bounds = nodes[leaves[i]].bounds;
+		float centroid[4];
+		_mm_storeu_ps(centroid, _mm_mul_ps(_mm_add_ps(bounds.vecmin, bounds.vecmax), _mm_set1_ps(0.5f)));
+		buildLeaves[i].bounds = bounds;
+		buildLeaves[i].centroid[0] = centroid[0];
+		buildLeaves[i].centroid[1] = centroid[1];
+		buildLeaves[i].centroid[2] = centroid[2];
+		buildLeaves[i].node = leaves[i];
+	}
+
+	// Split ranges off an explicit stack rather than recursing, since skewed inputs can make the tree deep.
+	int buildRoot = kNullNode;
+	std::vector<int> internalNodes;
+	internalNodes.reserve(leaves.size());
+	std::vector<BuildRange> ranges;
+	BuildRange all = { 0, (int)leaves.size(), kNullNode, true };
+	ranges.push_back(all);
+	while (!ranges.empty()) {
+		BuildRange range = ranges.back();
+		ranges.pop_back();
+		int node;
+		if (range.end - range.begin == 1) {
+			node = buildLeaves[range.begin].node;
+		}
+		else {
+			int split = SplitRange(buildLeaves, range.begin, range.end);
+			node = AllocateNode();
+			internalNodes.push_back(node);
+			BuildRange first = { range.begin, split, node, true };
+			BuildRange second = { split, range.end, node, false };
+			ranges.push_back(first);
+			ranges.push_back(second);
+		}
+		nodes[node].parent = range.parent;
+		if (range.parent == kNullNode) {
+			buildRoot = node;
+		}
+		else if (range.firstChild) {
+			nodes[range.parent].child1 = node;
+		}
+		else {
+			nodes[range.parent].child2 = node;
+		}
+	}
+
+	// Children are always allocated after their parent, so refitting in reverse order sees children first.
+	for (auto it = internalNodes.rbegin(); it != internalNodes.rend(); ++it) {
+		TreeNode& treeNode = nodes[*it];
+		const TreeNode& child1 = nodes[treeNode.child1];
+		const TreeNode& child2 = nodes[treeNode.child2];
+		treeNode.height = 1 + std::max(child1.height, child2.height);
+		treeNode.bounds = Union(child1.bounds, child2.bounds);
+	}
+	return buildRoot;
+};
+
+/// Frees every internal node and appends the leaves to leaves, for a rebuild over them.
+void DynamicAABBTree::ReleaseInternalNodes(std::vector<int>& leaves) {
+	if (root == kNullNode) return;
+	TraversalStack stack;
+	stack.Push(root);
+	while (!stack.Empty()) {
+		int index = stack.Pop();
+		if (nodes[index].IsLeaf()) {
+			leaves.push_back(index);
+		}
+		else {
+			stack.Push(nodes[index].child1);
+			stack.Push(nodes[index].child2);
+			FreeNode(index);
+		}
+	}
+	root = kNullNode;
+};
+
+/// Performs a left or right rotation if node is imbalanced, and returns the new root of the subtree.
+int DynamicAABBTree::Balance(int iA) {
+	TreeNode& A = nodes[iA];
+	if (A.IsLeaf() || A.height < 2) {
+		return iA;
+	}
+
+	int iB = A.child1;
+	int iC = A.child2;
+	TreeNode& B = nodes[iB];
+	TreeNode& C = nodes[iC];
+	int balance = C.height - B.height;
+
+	// Rotate C up.
+	if (balance > 1) {
+		int iF = C.child1;
+		int iG = C.child2;
+		TreeNode& F = nodes[iF];
+		TreeNode& G = nodes[iG];
+
+		C.child1 = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+		if (C.parent != kNullNode) {
+			if (nodes[C.parent].child1 == iA) {
+				nodes[C.parent].child1 = iC;
+			}
+			else {
+				nodes[C.parent].child2 = iC;
+			}
+		}
+		else {
+			root = iC;
+		}
+
+		// The taller of C's children stays with C, the shorter moves under A.
+		if (F.height > G.height) {
+			C.child2 = iF;
+			A.child2 = iG;
+			G.parent = iA;
+			A.bounds = Union(B.bounds, G.bounds);
+			C.bounds = Union(A.bounds, F.bounds);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		}
+		else {
+			C.child2 = iG;
+			A.child2 = iF;
+			F.parent = iA;
+			A.bounds = Union(B.bounds, F.bounds);
+			C.bounds = Union(A.bounds, G.bounds);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+		return iC;
+	}
+
+	// Rotate B up.
+	if (balance < -1) {
+		int iD = B.child1;
+		int iE = B.child2;
+		TreeNode& D = nodes[iD];
+		TreeNode& E = nodes[iE];
+
+		B.child1 = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+		if (B.parent != kNullNode) {
+			if (nodes[B.parent].child1 == iA) {
+				nodes[B.parent].child1 = iB;
+			}
+			else {
+				nodes[B.parent].child2 = iB;
+			}
+		}
+		else {
+			root = iB;
+		}
+
+		if (D.height > E.height) {
+			B.child2 = iD;
+			A.child1 = iE;
+			E.parent = iA;
+			A.bounds = Union(C.bounds, E.bounds);
+			B.bounds = Union(A.bounds, D.bounds);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		}
+		else {
+			B.child2 = iE;
+			A.child1 = iD;
+			D.parent = iA;
+			A.bounds = Union(C.bounds, D.bounds);
+			B.bounds = Union(A.bounds, E.bounds);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+		return iB;
+	}
+
+	return iA;
+};
+
+/// Writes the ids of items fully contained by testBounds into returnArray, stopping at returnArrayMaxSize.
+int DynamicAABBTree::ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	if (root == kNullNode) return curNumResults;
+
+	// Subtrees whose bounds are fully contained are pushed complemented, and every leaf below them is
+	// reported without testing, since item bounds never exceed their ancestors' bounds.
+	TraversalStack stack;
+	stack.Push(root);
+	while (!stack.Empty()) {
+		int index = stack.Pop();
+		bool inside = index < 0;
+		const TreeNode& node = nodes[inside ? ~index : index];
+		if (!inside) {
+			if (!intersects(testBounds, node.bounds)) continue;
+			inside = contains(testBounds, node.bounds) != 0;
+		}
+		if (node.IsLeaf()) {
+			if (inside || contains(testBounds, node.itemBounds)) {
+				returnArray[curNumResults] = node.itemId;
+				curNumResults++;
+				if (curNumResults >= returnArrayMaxSize) return curNumResults;
+			}
+		}
+		else {
+			stack.Push(inside ? ~node.child1 : node.child1);
+			stack.Push(inside ? ~node.child2 : node.child2);
+		}
+	}
+	return curNumResults;
+};
+
+/// Writes the ids of items intersecting testBounds into returnArray, stopping at returnArrayMaxSize.
+int DynamicAABBTree::IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	if (root == kNullNode) return curNumResults;
+
+	TraversalStack stack;
+	stack.Push(root);
+	while (!stack.Empty()) {
+		const TreeNode& node = nodes[stack.Pop()];
+		if (!intersects(testBounds, node.bounds)) continue;
+		if (node.IsLeaf()) {
+			if (intersects(testBounds, node.itemBounds)) {
+				returnArray[curNumResults] = node.itemId;
+				curNumResults++;
+				if (curNumResults >= returnArrayMaxSize) return curNumResults;
+			}
+		}
+		else {
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+	return curNumResults;
+};
+
+/// Hands the items overlapping the visitor's shape to the visitor. Subtrees classified inside are pushed
+/// complemented, and their leaves are visited without classifying them.
+void DynamicAABBTree::Traverse(SpatialVisitor& visitor) const {
+	if (root == kNullNode) return;
+
+	TraversalStack stack;
+	stack.Push(root);
+	while (!stack.Empty()) {
+		int index = stack.Pop();
+		bool inside = index < 0;
+		const TreeNode& node = nodes[inside ? ~index : index];
+		if (node.IsLeaf()) {
+			SpatialOverlap overlap = inside ? SPATIAL_INSIDE : visitor.Classify(node.itemBounds);
+			if (overlap != SPATIAL_OUTSIDE && !visitor.Visit(node.itemId, node.itemBounds, overlap)) return;
+			continue;
+		}
+		if (!inside) {
+			SpatialOverlap overlap = visitor.Classify(node.bounds);
+			if (overlap == SPATIAL_OUTSIDE) continue;
+			inside = overlap == SPATIAL_INSIDE;
+		}
+		stack.Push(inside ? ~node.child1 : node.child1);
+		stack.Push(inside ? ~node.child2 : node.child2);
+	}
+};
+
+/// Visits nodes closest first from a priority queue, and stops once the closest queued node lies beyond the
+/// visitor's MaxDistance, which for a closest-hit query is usually right after the first hit.
+void DynamicAABBTree::TraverseNearest(NearestVisitor& visitor) const {
+	if (root == kNullNode) return;
+	// Leaves are queued at the distance of their exact bounds, so items are visited in order of distance.
+	const TreeNode& rootNode = nodes[root];
+	NearestEntry entry = { visitor.Distance(rootNode.IsLeaf() ? rootNode.itemBounds : rootNode.bounds), root };
+	if (entry.distance < 0) return;
+
+	std::vector<NearestEntry> queue;
+	queue.push_back(entry);
+	while (!queue.empty()) {
+		std::pop_heap(queue.begin(), queue.end(), Farther);
+		entry = queue.back();
+		queue.pop_back();
+		if (entry.distance > visitor.MaxDistance()) return;
+
+		const TreeNode& node = nodes[entry.node];
+		if (node.IsLeaf()) {
+			visitor.Visit(node.itemId, node.itemBounds, entry.distance);
+			continue;
+		}
+		int children[2] = { node.child1, node.child2 };
+		for (int i = 0; i < 2; i++) {
+			const TreeNode& childNode = nodes[children[i]];
+			NearestEntry child = { visitor.Distance(childNode.IsLeaf() ? childNode.itemBounds : childNode.bounds), children[i] };
+			if (child.distance < 0 || child.distance > visitor.MaxDistance()) continue;
+			queue.push_back(child);
+			std::push_heap(queue.begin(), queue.end(), Farther);
+		}
+	}
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include "AABB.h"
+#include "SpatialIndex.h"
+#include <vector>
+
+/// A node of the DynamicAABBTree. Leaves hold one item each; internal nodes always have two children.
+struct TreeNode {
+	/// Bounds used for traversal. For leaves these are the item bounds enlarged by a margin, so that small
+	/// moves don't have to restructure the tree.
+	AABB bounds;
+	/// Exact bounds of the item, only meaningful for leaves.
+	AABB itemBounds;
+	/// Parent node, or the next free node while this node is on the free list.
+	int parent;
+	int child1;
+	int child2;
+	/// Leaves have height 0, free nodes have height -1.
+	int height;
+	int itemId;
+
+	bool IsLeaf() const {
+		return child1 == -1;
+	}
+};
+
+/// Bounding volume hierarchy that is maintained incrementally as items are inserted, moved and removed.
+/// Leaves are inserted next to the sibling that minimizes the surface area cost, and the tree is kept
+/// balanced with AVL-style rotations, so queries stay logarithmic in the number of items.
+class DynamicAABBTree : public SpatialIndex {
+public:
+	DynamicAABBTree();
+	~DynamicAABBTree() {};
+
+	int Insert(int itemId, const AABB& bounds) override;
+	void InsertMany(const AABB* bounds, int count, int* proxies) override;
+	void Update(int proxy, const AABB& bounds) override;
+	void Remove(int proxy) override;
+	void UpdateMany(const int* proxies, const AABB* bounds, int count) override;
+	void RemoveMany(const int* proxies, int count) override;
+	void Clear() override;
+	int ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	int IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	void Traverse(SpatialVisitor& visitor) const override;
+	void TraverseNearest(NearestVisitor& visitor) const override;
+
+	/// Returns the height of the tree, or -1 if it is empty.
+	int GetHeight() const;
+
+private:
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	/// Refits bounds and heights from node up to the root, rebalancing on the way.
+	void RefitAncestors(int node);
+	/// Performs a left or right rotation if node is imbalanced, and returns the new root of the subtree.
+	int Balance(int node);
+	/// Builds a tree over the given leaves top down, splitting at the binned surface area optimum, and
+	/// returns its root.
+	int Build(const std::vector<int>& leaves);
+	/// Frees every internal node and appends the leaves to leaves, for a rebuild over them.
+	void ReleaseInternalNodes(std::vector<int>& leaves);
+
+	std::vector<TreeNode> nodes;
+	int root;
+	int freeList;
+	int leafCount;
+	/// Marks the ancestors already gathered by the current UpdateMany, by the stamp of that call.
+	std::vector<unsigned int> refitStamps;
+	unsigned int refitStamp;
+};
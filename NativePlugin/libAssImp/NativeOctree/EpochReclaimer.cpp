@@ -0,0 +1,64 @@
+#include "EpochReclaimer.h"
+#include <thread>
+
+EpochReclaimer& EpochReclaimer::Instance() {
+	static EpochReclaimer reclaimer;
+	return reclaimer;
+};
+
+/// Epochs start at 1, since 0 marks a free slot.
+EpochReclaimer::EpochReclaimer() : epoch(1) {
+	for (int i = 0; i < kReaderSlots; i++) {
+		slots[i].epoch = 0;
+	}
+};
+
+/// Guards the calling thread holds. Only the outermost one holds a slot.
+static thread_local int readGuardDepth = 0;
+
+/// Claims a free slot and announces the current epoch in it with the same compare and swap. The epoch read may
+/// already have ended by then, which only makes writers wait longer to free memory. A guard nested in another
+/// takes no slot, since the outer guard's epoch is no later than its own, so a thread never waits on itself.
+EpochReclaimer::ReadGuard::ReadGuard() {
+	if (readGuardDepth++ > 0) {
+		slot = -1;
+		return;
+	}
+	EpochReclaimer& reclaimer = Instance();
+	for (;;) {
+		uint64_t current = reclaimer.epoch.load();
+		for (slot = 0; slot < kReaderSlots; slot++) {
+			uint64_t expected = 0;
+			if (reclaimer.slots[slot].epoch.compare_exchange_strong(expected, current)) return;
+		}
+		std::this_thread::yield();
+	}
+};
+
+EpochReclaimer::ReadGuard::~ReadGuard() {
+	readGuardDepth--;
+	if (slot >= 0) {
+		Instance().slots[slot].epoch.store(0);
+	}
+};
+
+/// Ends the current epoch and returns it.
+uint64_t EpochReclaimer::Advance() {
+	return epoch.fetch_add(1);
+};
+
+/// Returns whether every reader in epoch or an earlier one has left.
+bool EpochReclaimer::ReadersLeft(uint64_t epoch) const {
+	for (int i = 0; i < kReaderSlots; i++) {
+		uint64_t announced = slots[i].epoch.load();
+		if (announced != 0 && announced <= epoch) return false;
+	}
+	return true;
+};
+
+/// Waits until every reader in epoch or an earlier one has left.
+void EpochReclaimer::WaitForReaders(uint64_t epoch) const {
+	while (!ReadersLeft(epoch)) {
+		std::this_thread::yield();
+	}
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/// Epoch-based reclamation for objects that readers reach through an atomic pointer without taking a lock. A
+/// reader announces the current epoch in a slot for as long as it holds such a pointer. A writer that swaps a
+/// pointer ends the epoch with Advance, and may free the object it replaced once no reader is left in that epoch
+/// or an earlier one. Readers never wait for writers, and writers wait for readers only to free memory.
+class EpochReclaimer {
+public:
+	/// Returns the reclaimer shared by the library.
+	static EpochReclaimer& Instance();
+
+	/// Holds a reader slot in the current epoch for the guard's lifetime. Pointers loaded while the guard lives
+	/// stay valid until it is destroyed. Guards nest: one created while the thread already holds a guard shares
+	/// that guard's slot.
+	class ReadGuard {
+	public:
+		ReadGuard();
+		~ReadGuard();
+
+	private:
+		ReadGuard(const ReadGuard&) = delete;
+		ReadGuard& operator=(const ReadGuard&) = delete;
+
+		/// The slot held, or -1 for a nested guard.
+		int slot;
+	};
+
+	/// Ends the current epoch and returns it. An object unlinked before the call can be freed once
+	/// ReadersLeft(epoch) is true.
+	uint64_t Advance();
+
+	/// Returns whether every reader in epoch or an earlier one has left.
+	bool ReadersLeft(uint64_t epoch) const;
+
+	/// Waits until ReadersLeft(epoch).
+	void WaitForReaders(uint64_t epoch) const;
+
+private:
+	EpochReclaimer();
+
+	/// Most readers at once. Further readers wait for a slot to free up.
+	static const int kReaderSlots = 64;
+
+	/// A reader's announced epoch, or 0 while the slot is free. Each slot sits on its own cache line, so readers
+	/// on different cores don't contend.
+	struct ReaderSlot {
+		alignas(64) std::atomic<uint64_t> epoch;
+	};
+
+	ReaderSlot slots[kReaderSlots];
+	std::atomic<uint64_t> epoch;
+};
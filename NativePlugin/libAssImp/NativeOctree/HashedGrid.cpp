@@ -0,0 +1,260 @@
+#include "HashedGrid.h"
+#include <algorithm>
+#include <cmath>
+
+static const int kNullIndex = -1;
+
+/// Cell coordinates are clamped to this magnitude, so far-away or non-finite bounds still map to a cell.
+static const double kCoordinateLimit = 1099511627776.0;
+
+/// Bits each cell coordinate keeps in a cell key. Coordinates that differ by a multiple of 2^kCoordinateBits
+/// share a key, which only costs extra item tests since every item is tested against the query.
+static const int kCoordinateBits = 19;
+
+/// Queries spanning more cells than this on any axis scan the level's item list instead, which also keeps
+/// a query from visiting two coordinates that share a key.
+static const int64_t kMaxCellSpan = 1 << 16;
+
+/// Widens the first cell an intersection query visits, so rounding in the query's cell coordinates can't
+/// skip the cell of an item that only just reaches the query.
+static const double kCellSlack = 1e-6;
+
+static int64_t CellCoordinate(double scaled) {
+	if (!(scaled > -kCoordinateLimit)) return (int64_t)-kCoordinateLimit;
+	if (!(scaled < kCoordinateLimit)) return (int64_t)kCoordinateLimit;
+	return (int64_t)std::floor(scaled);
+}
+
+static uint64_t PackCell(int level, int64_t x, int64_t y, int64_t z) {
+	const uint64_t mask = (1ull << kCoordinateBits) - 1;
+	return ((uint64_t)level << (3 * kCoordinateBits)) |
+		(((uint64_t)x & mask) << (2 * kCoordinateBits)) |
+		(((uint64_t)y & mask) << kCoordinateBits) |
+		((uint64_t)z & mask);
+}
+
+HashedGrid::HashedGrid(float baseCellSize, int levelCount) : freeItem(kNullIndex) {
+	this->levelCount = std::min(std::max(levelCount, 1), kMaxGridLevels);
+	double size = baseCellSize > 0 ? baseCellSize : 0.01;
+	for (int level = 0; level < this->levelCount; level++) {
+		cellSize[level] = size;
+		inverseCellSize[level] = 1.0 / size;
+		size *= 2;
+	}
+};
+
+/// Returns the finest level whose cells are at least as large as bounds, or levelCount if none are.
+int HashedGrid::LevelFor(const AABB& bounds) const {
+	float boundsMin[4];
+	float boundsMax[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	_mm_storeu_ps(boundsMax, bounds.vecmax);
+	double size = std::max((double)boundsMax[0] - boundsMin[0],
+		std::max((double)boundsMax[1] - boundsMin[1], (double)boundsMax[2] - boundsMin[2]));
+	for (int level = 0; level < levelCount; level++) {
+		if (size <= cellSize[level]) return level;
+	}
+	return levelCount;
+};
+
+/// Returns the key of the cell at level holding the min corner of bounds.
+uint64_t HashedGrid::CellFor(int level, const AABB& bounds) const {
+	if (level == levelCount) return 0;
+	float boundsMin[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	double scale = inverseCellSize[level];
+	return PackCell(level,
+		CellCoordinate(boundsMin[0] * scale),
+		CellCoordinate(boundsMin[1] * scale),
+		CellCoordinate(boundsMin[2] * scale));
+};
+
+void HashedGrid::Link(int item, int level, uint64_t cell) {
+	GridItem& gridItem = items[item];
+	gridItem.level = level;
+	gridItem.cell = cell;
+	gridItem.levelSlot = (int)levelItems[level].size();
+	levelItems[level].push_back(item);
+	gridItem.prev = kNullIndex;
+	gridItem.next = kNullIndex;
+	if (level == levelCount) return;
+
+	std::pair<std::unordered_map<uint64_t, int>::iterator, bool> inserted = cells.insert(std::make_pair(cell, item));
+	if (!inserted.second) {
+		int head = inserted.first->second;
+		gridItem.next = head;
+		items[head].prev = item;
+		inserted.first->second = item;
+	}
+};
+
+void HashedGrid::Unlink(int item) {
+	GridItem& gridItem = items[item];
+	std::vector<int>& levelList = levelItems[gridItem.level];
+	int moved = levelList.back();
+	levelList[gridItem.levelSlot] = moved;
+	items[moved].levelSlot = gridItem.levelSlot;
+	levelList.pop_back();
+	if (gridItem.level == levelCount) return;
+
+	if (gridItem.prev != kNullIndex) {
+		items[gridItem.prev].next = gridItem.next;
+	}
+	else if (gridItem.next != kNullIndex) {
+		cells[gridItem.cell] = gridItem.next;
+	}
+	else {
+		cells.erase(gridItem.cell);
+	}
+	if (gridItem.next != kNullIndex) {
+		items[gridItem.next].prev = gridItem.prev;
+	}
+};
+
+int HashedGrid::Insert(int itemId, const AABB& bounds) {
+	int item;
+	if (freeItem != kNullIndex) {
+		item = freeItem;
+		freeItem = items[item].itemId;
+	}
+	else {
+		item = (int)items.size();
+		items.push_back(GridItem());
+	}
+	items[item].bounds = bounds;
+	items[item].itemId = itemId;
+	int level = LevelFor(bounds);
+	Link(item, level, CellFor(level, bounds));
+	return item;
+};
+
+/// Moves the item behind proxy to new bounds. The item is only relinked if its level or cell changed.
+void HashedGrid::Update(int proxy, const AABB& bounds) {
+	items[proxy].bounds = bounds;
+	int level = LevelFor(bounds);
+	uint64_t cell = CellFor(level, bounds);
+	if (level == items[proxy].level && cell == items[proxy].cell) return;
+	Unlink(proxy);
+	Link(proxy, level, cell);
+};
+
+void HashedGrid::Remove(int proxy) {
+	Unlink(proxy);
+	items[proxy].level = kNullIndex;
+	items[proxy].itemId = freeItem;
+	freeItem = proxy;
+};
+
+void HashedGrid::Clear() {
+	items.clear();
+	freeItem = kNullIndex;
+	cells.clear();
+	for (int level = 0; level <= kMaxGridLevels; level++) {
+		levelItems[level].clear();
+	}
+};
+
+/// Hands every item lying inside testBounds, or intersecting it if contained isn't set, to emit until emit
+/// returns false. Returns false if emit stopped it.
+template <typename Emit>
+bool HashedGrid::ForEachMatch(const AABB& testBounds, bool contained, Emit& emit) const {
+	float testMin[4];
+	float testMax[4];
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+
+	for (int level = 0; level <= levelCount; level++) {
+		const std::vector<int>& levelList = levelItems[level];
+		if (levelList.empty()) continue;
+
+		// An item's min corner lies inside a contained query, and at most one cell size below an
+		// intersecting one, since every item at this level is smaller than a cell.
+		bool scanLevel = level == levelCount;
+		int64_t first[3];
+		int64_t last[3];
+		if (!scanLevel) {
+			double scale = inverseCellSize[level];
+			double cellCount = 1;
+			for (int axis = 0; axis < 3; axis++) {
+				first[axis] = contained ?
+					CellCoordinate(testMin[axis] * scale) :
+					CellCoordinate((testMin[axis] - cellSize[level]) * scale - kCellSlack);
+				last[axis] = CellCoordinate(testMax[axis] * scale);
+				cellCount *= (double)std::max(last[axis] - first[axis] + 1, (int64_t)0);
+				if (last[axis] - first[axis] >= kMaxCellSpan) {
+					scanLevel = true;
+				}
+			}
+			if (cellCount == 0) continue;
+			if (cellCount > (double)levelList.size()) {
+				scanLevel = true;
+			}
+		}
+
+		if (scanLevel) {
+			for (auto it = levelList.begin(); it != levelList.end(); ++it) {
+				const GridItem& gridItem = items[*it];
+				if (contained ? contains(testBounds, gridItem.bounds) : intersects(testBounds, gridItem.bounds)) {
+					if (!emit(gridItem)) return false;
+				}
+			}
+			continue;
+		}
+
+		for (int64_t z = first[2]; z <= last[2]; z++) {
+			for (int64_t y = first[1]; y <= last[1]; y++) {
+				for (int64_t x = first[0]; x <= last[0]; x++) {
+					std::unordered_map<uint64_t, int>::const_iterator cell = cells.find(PackCell(level, x, y, z));
+					if (cell == cells.end()) continue;
+					for (int item = cell->second; item != kNullIndex; item = items[item].next) {
+						const GridItem& gridItem = items[item];
+						if (contained ? contains(testBounds, gridItem.bounds) : intersects(testBounds, gridItem.bounds)) {
+							if (!emit(gridItem)) return false;
+						}
+					}
+				}
+			}
+		}
+	}
+	return true;
+};
+
+/// Runs the query on every occupied level. With contained set, items must lie inside testBounds,
+/// otherwise they must intersect it.
+int HashedGrid::Query(const AABB& testBounds, bool contained, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	auto emit = [&](const GridItem& gridItem) {
+		returnArray[curNumResults] = gridItem.itemId;
+		curNumResults++;
+		return curNumResults < returnArrayMaxSize;
+	};
+	ForEachMatch(testBounds, contained, emit);
+	return curNumResults;
+};
+
+int HashedGrid::ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	return Query(testBounds, true, returnArray, returnArrayMaxSize);
+};
+
+int HashedGrid::IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	return Query(testBounds, false, returnArray, returnArrayMaxSize);
+};
+
+/// Classifies the items intersecting the visitor's bounds.
+void HashedGrid::Traverse(SpatialVisitor& visitor) const {
+	auto emit = [&](const GridItem& gridItem) {
+		SpatialOverlap overlap = visitor.Classify(gridItem.bounds);
+		return overlap == SPATIAL_OUTSIDE || visitor.Visit(gridItem.itemId, gridItem.bounds, overlap);
+	};
+	ForEachMatch(visitor.Bounds(), false, emit);
+};
+
+int HashedGrid::Count(const AABB& testBounds, bool contained, int maxCount) const {
+	int count = 0;
+	auto emit = [&](const GridItem& gridItem) {
+		count++;
+		return count < maxCount;
+	};
+	ForEachMatch(testBounds, contained, emit);
+	return count;
+};
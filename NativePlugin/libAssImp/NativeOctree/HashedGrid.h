@@ -0,0 +1,68 @@
+#pragma once
+#include "AABB.h"
+#include "SpatialIndex.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/// Most levels a HashedGrid can be configured with.
+static const int kMaxGridLevels = 24;
+
+/// An item of the HashedGrid, linked into the list of the one cell it is registered in.
+struct GridItem {
+	AABB bounds;
+	/// The item's id, or the next free slot while the slot is free.
+	int itemId;
+	/// The level the item is registered at, or -1 while the slot is free.
+	int level;
+	/// Position of the item in its level's item list.
+	int levelSlot;
+	/// Hash key of the cell holding the item's min corner.
+	uint64_t cell;
+	int prev;
+	int next;
+};
+
+/// Hierarchical spatial hash. Level l has cubic cells of baseCellSize * 2^l, and each item is registered in
+/// the single cell holding its min corner, at the finest level whose cells are at least as large as the item.
+/// Inserts, moves and removes are O(1), and a query visits only the cells that can hold an overlapping item's
+/// min corner on each occupied level, or that level's item list if it is shorter.
+class HashedGrid : public SpatialIndex {
+public:
+	HashedGrid(float baseCellSize = 0.01f, int levelCount = 16);
+	~HashedGrid() {};
+
+	int Insert(int itemId, const AABB& bounds) override;
+	void Update(int proxy, const AABB& bounds) override;
+	void Remove(int proxy) override;
+	void Clear() override;
+	int ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	int IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	void Traverse(SpatialVisitor& visitor) const override;
+	int Count(const AABB& testBounds, bool contained, int maxCount) const override;
+
+private:
+	/// Returns the finest level whose cells are at least as large as bounds, or levelCount if none are.
+	int LevelFor(const AABB& bounds) const;
+	/// Returns the key of the cell at level holding the min corner of bounds.
+	uint64_t CellFor(int level, const AABB& bounds) const;
+	void Link(int item, int level, uint64_t cell);
+	void Unlink(int item);
+	/// Hands every item lying inside testBounds, or intersecting it if contained isn't set, to emit until emit
+	/// returns false. Returns false if emit stopped it.
+	template <typename Emit>
+	bool ForEachMatch(const AABB& testBounds, bool contained, Emit& emit) const;
+	/// Runs the query on every occupied level. With contained set, items must lie inside testBounds,
+	/// otherwise they must intersect it.
+	int Query(const AABB& testBounds, bool contained, int* returnArray, int returnArrayMaxSize) const;
+
+	std::vector<GridItem> items;
+	int freeItem;
+	/// Head of each occupied cell's item list.
+	std::unordered_map<uint64_t, int> cells;
+	/// Items registered at each level. The extra last level holds items too large for any cell.
+	std::vector<int> levelItems[kMaxGridLevels + 1];
+	double cellSize[kMaxGridLevels];
+	double inverseCellSize[kMaxGridLevels];
+	int levelCount;
+};
@@ -0,0 +1,98 @@
+#include "ItemIdMap.h"
+
+/// Entries a non-empty map starts with.
+static const size_t kMinIdMapCapacity = 16;
+
+ItemIdMap::ItemIdMap() : count(0), shift(32) {
+
+};
+
+/// Fibonacci hashing, which keeps consecutive ids apart and scatters ids that share their low bits.
+size_t ItemIdMap::Home(int itemId) const {
+	return (size_t)(((uint32_t)itemId * 2654435769u) >> shift);
+};
+
+size_t ItemIdMap::Probe(int itemId) const {
+	size_t mask = entries.size() - 1;
+	size_t slot = Home(itemId);
+	while (entries[slot].element >= 0 && entries[slot].itemId != itemId) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+};
+
+int ItemIdMap::Find(int itemId) const {
+	if (count == 0) return kMissing;
+	const Entry& entry = entries[Probe(itemId)];
+	return entry.element >= 0 ? entry.element : kMissing;
+};
+
+/// Keeps the table at most three quarters full.
+void ItemIdMap::Set(int itemId, int element) {
+	if ((count + 1) * 4 > entries.size() * 3) {
+		Rehash(entries.empty() ? kMinIdMapCapacity : entries.size() * 2);
+	}
+	Entry& entry = entries[Probe(itemId)];
+	if (entry.element < 0) {
+		entry.itemId = itemId;
+		count++;
+	}
+	entry.element = element;
+};
+
+/// Fills the freed entry with the next entry of the run that may live there, and repeats from that entry, so
+/// every probe sequence stays unbroken.
+bool ItemIdMap::Erase(int itemId) {
+	if (count == 0) return false;
+	size_t hole = Probe(itemId);
+	if (entries[hole].element < 0) return false;
+	size_t mask = entries.size() - 1;
+	for (size_t next = (hole + 1) & mask; entries[next].element >= 0; next = (next + 1) & mask) {
+		// The entry can move back to hole unless its home lies after hole, cyclically.
+		size_t home = Home(entries[next].itemId);
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			entries[hole] = entries[next];
+			hole = next;
+		}
+	}
+	entries[hole].element = kMissing;
+	count--;
+	return true;
+};
+
+void ItemIdMap::Clear() {
+	for (size_t i = 0; i < entries.size(); i++) {
+		entries[i].element = kMissing;
+	}
+	count = 0;
+};
+
+void ItemIdMap::Reserve(size_t itemCount) {
+	size_t capacity = entries.empty() ? kMinIdMapCapacity : entries.size();
+	while (itemCount * 4 > capacity * 3) {
+		capacity *= 2;
+	}
+	if (capacity != entries.size()) {
+		Rehash(capacity);
+	}
+};
+
+size_t ItemIdMap::Size() const {
+	return count;
+};
+
+void ItemIdMap::Rehash(size_t capacity) {
+	std::vector<Entry> old;
+	old.swap(entries);
+	Entry free = { 0, kMissing };
+	entries.assign(capacity, free);
+	shift = 32;
+	for (size_t size = capacity; size > 1; size >>= 1) {
+		shift--;
+	}
+	for (size_t i = 0; i < old.size(); i++) {
+		if (old[i].element >= 0) {
+			entries[Probe(old[i].itemId)] = old[i];
+		}
+	}
+};
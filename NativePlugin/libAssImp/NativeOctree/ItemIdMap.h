@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Maps item ids to their element positions in a flat open-addressing table with linear probing. Ids are chosen
+/// by the caller and may be sparse, so they are hashed rather than used as array positions, but entries sit inline
+/// in one array, so a lookup touches one or two cache lines and nothing is allocated per item. Removal shifts the
+/// following entries back instead of leaving tombstones, so lookups don't slow down as items come and go.
+class ItemIdMap {
+public:
+	/// Returned by Find for ids that aren't in the map.
+	static const int kMissing = -1;
+
+	ItemIdMap();
+
+	/// Returns the element of itemId, or kMissing if itemId isn't in the map.
+	int Find(int itemId) const;
+
+	/// Maps itemId to element, which must not be negative, replacing any element it had.
+	void Set(int itemId, int element);
+
+	/// Removes itemId, and returns whether it was in the map.
+	bool Erase(int itemId);
+
+	void Clear();
+
+	/// Makes room for itemCount ids without growing.
+	void Reserve(size_t itemCount);
+
+	size_t Size() const;
+
+private:
+	/// An id and its element, or a free entry if element is negative.
+	struct Entry {
+		int itemId;
+		int element;
+	};
+
+	/// Returns the entry itemId probes first.
+	size_t Home(int itemId) const;
+
+	/// Returns the entry holding itemId, or the free entry ending its probe sequence.
+	size_t Probe(int itemId) const;
+
+	/// Rehashes into capacity entries, a power of two.
+	void Rehash(size_t capacity);
+
+	std::vector<Entry> entries;
+	size_t count;
+	/// Bits of the hash Home keeps, log2 of the capacity.
+	int shift;
+};
@@ -0,0 +1,164 @@
+#include "LinearScan.h"
+#include "ScanKernels.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+static const int kNullIndex = -1;
+
+/// Boxes in each slice of a scan split across the thread pool.
+static const size_t kScanSliceSize = 16384;
+
+typedef int(*RangeScan)(const AABBArray& boxes, size_t begin, size_t end, const AABB& testBounds, int* returnArray, int returnArrayMaxSize);
+
+/// Hit buffers of the slices after the first, back to back, kept by each thread that splits scans so a scan
+/// neither allocates nor clears them anew. Only grows.
+static thread_local std::vector<int> sliceScratch;
+
+/// Returns whether a scan of size boxes is split across the thread pool, which takes enough boxes for the pool
+/// and more than one slice.
+static bool SplitsScan(size_t size) {
+	return size > kScanSliceSize && ThreadPool::Instance().RunsInParallel(size);
+}
+
+/// Scans boxes in slices on the thread pool, the first straight into returnArray and the others into their own
+/// part of the calling thread's scratch buffer, and joins the hits in array order up to returnArrayMaxSize, so
+/// the ids come out as from a scan on one thread. Unlike that scan it can't stop early once the array is full.
+static int ParallelScan(const AABBArray& boxes, RangeScan scan, const AABB& testBounds, int* returnArray, int returnArrayMaxSize) {
+	int sliceCount = (int)((boxes.Size() + kScanSliceSize - 1) / kScanSliceSize);
+	size_t sliceCapacity = std::min((size_t)returnArrayMaxSize, kScanSliceSize);
+	// Bound here, since the workers would see their own scratch buffers through the name.
+	std::vector<int>& scratch = sliceScratch;
+	if (scratch.size() < (sliceCount - 1) * sliceCapacity) {
+		scratch.resize((sliceCount - 1) * sliceCapacity);
+	}
+	std::vector<int> sliceCounts(sliceCount);
+	ThreadPool::Instance().ParallelFor(sliceCount, 1, [&](int first, int last) {
+		for (int slice = first; slice < last; slice++) {
+			size_t begin = slice * kScanSliceSize;
+			size_t end = std::min(begin + kScanSliceSize, boxes.Size());
+			if (slice == 0) {
+				sliceCounts[slice] = scan(boxes, begin, end, testBounds, returnArray, returnArrayMaxSize);
+			}
+			else {
+				int* hits = scratch.data() + (slice - 1) * sliceCapacity;
+				sliceCounts[slice] = scan(boxes, begin, end, testBounds, hits, (int)std::min(sliceCapacity, end - begin));
+			}
+		}
+	});
+
+	int curNumResults = sliceCounts[0];
+	for (int slice = 1; slice < sliceCount && curNumResults < returnArrayMaxSize; slice++) {
+		int count = std::min(sliceCounts[slice], returnArrayMaxSize - curNumResults);
+		const int* hits = scratch.data() + (slice - 1) * sliceCapacity;
+		std::copy(hits, hits + count, returnArray + curNumResults);
+		curNumResults += count;
+	}
+	return curNumResults;
+}
+
+LinearScan::LinearScan() : freeProxy(kNullIndex) {
+
+};
+
+int LinearScan::Insert(int itemId, const AABB& bounds) {
+	int proxy;
+	if (freeProxy != kNullIndex) {
+		proxy = freeProxy;
+		freeProxy = proxySlots[proxy];
+	}
+	else {
+		proxy = (int)proxySlots.size();
+		proxySlots.push_back(kNullIndex);
+	}
+	proxySlots[proxy] = (int)boxes.Size();
+	boxes.Push(itemId, bounds);
+	boxProxies.push_back(proxy);
+	return proxy;
+};
+
+void LinearScan::InsertMany(const AABB* bounds, int count, int* proxies) {
+	boxes.Reserve(boxes.Size() + count);
+	boxProxies.reserve(boxProxies.size() + count);
+	SpatialIndex::InsertMany(bounds, count, proxies);
+};
+
+void LinearScan::Update(int proxy, const AABB& bounds) {
+	boxes.Set(proxySlots[proxy], bounds);
+};
+
+void LinearScan::Remove(int proxy) {
+	int slot = proxySlots[proxy];
+	int last = (int)boxes.Size() - 1;
+	if (slot != last) {
+		boxes.Move(slot, last);
+		boxProxies[slot] = boxProxies[last];
+		proxySlots[boxProxies[slot]] = slot;
+	}
+	boxes.PopBack();
+	boxProxies.pop_back();
+	proxySlots[proxy] = freeProxy;
+	freeProxy = proxy;
+};
+
+void LinearScan::Clear() {
+	boxes.Clear();
+	boxProxies.clear();
+	proxySlots.clear();
+	freeProxy = kNullIndex;
+};
+
+/// Splits the scan across the thread pool once there are enough boxes.
+int LinearScan::ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	if (returnArrayMaxSize > 0 && SplitsScan(boxes.Size())) {
+		return ParallelScan(boxes, ScanContainedBy, testBounds, returnArray, returnArrayMaxSize);
+	}
+	return ScanContainedBy(boxes, testBounds, returnArray, returnArrayMaxSize);
+};
+
+/// Splits the scan across the thread pool once there are enough boxes.
+int LinearScan::IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	if (returnArrayMaxSize > 0 && SplitsScan(boxes.Size())) {
+		return ParallelScan(boxes, ScanIntersectedBy, testBounds, returnArray, returnArrayMaxSize);
+	}
+	return ScanIntersectedBy(boxes, testBounds, returnArray, returnArrayMaxSize);
+};
+
+/// Classifies the boxes intersecting the visitor's bounds.
+void LinearScan::Traverse(SpatialVisitor& visitor) const {
+	float testMin[4];
+	float testMax[4];
+	AABB testBounds = visitor.Bounds();
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+	for (size_t i = 0; i < boxes.Size(); i++) {
+		if (testMax[0] < boxes.minX[i] || testMin[0] > boxes.maxX[i] ||
+			testMax[1] < boxes.minY[i] || testMin[1] > boxes.maxY[i] ||
+			testMax[2] < boxes.minZ[i] || testMin[2] > boxes.maxZ[i]) continue;
+		AABB bounds = boxes.Get(i);
+		SpatialOverlap overlap = visitor.Classify(bounds);
+		if (overlap != SPATIAL_OUTSIDE && !visitor.Visit(boxes.ids[i], bounds, overlap)) return;
+	}
+};
+
+int LinearScan::Count(const AABB& testBounds, bool contained, int maxCount) const {
+	float testMin[4];
+	float testMax[4];
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+	int count = 0;
+	for (size_t i = 0; i < boxes.Size(); i++) {
+		if (contained) {
+			if (testMin[0] > boxes.minX[i] || testMax[0] < boxes.maxX[i] ||
+				testMin[1] > boxes.minY[i] || testMax[1] < boxes.maxY[i] ||
+				testMin[2] > boxes.minZ[i] || testMax[2] < boxes.maxZ[i]) continue;
+		}
+		else {
+			if (testMax[0] < boxes.minX[i] || testMin[0] > boxes.maxX[i] ||
+				testMax[1] < boxes.minY[i] || testMin[1] > boxes.maxY[i] ||
+				testMax[2] < boxes.minZ[i] || testMin[2] > boxes.maxZ[i]) continue;
+		}
+		count++;
+		if (count >= maxCount) break;
+	}
+	return count;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include "AABB.h"
+#include "AABBArray.h"
+#include "SpatialIndex.h"
+#include <vector>
+
+/// Flat array of item bounds that every query scans in full, several items per instruction. Removes swap the
+/// last item into the hole, so the arrays stay dense. With no structure to maintain, this is the fastest
+/// backend for a few dozen items, and for workloads that move nearly every item between queries.
+class LinearScan : public SpatialIndex {
+public:
+	LinearScan();
+	~LinearScan() {};
+
+	int Insert(int itemId, const AABB& bounds) override;
+	void InsertMany(const AABB* bounds, int count, int* proxies) override;
+	void Update(int proxy, const AABB& bounds) override;
+	void Remove(int proxy) override;
+	void Clear() override;
+	int ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	int IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	void Traverse(SpatialVisitor& visitor) const override;
+	int Count(const AABB& testBounds, bool contained, int maxCount) const override;
+
+private:
+	AABBArray boxes;
+	/// Proxy of each box, parallel to boxes.
+	std::vector<int> boxProxies;
+	/// Position in boxes of each proxy's item, or the next free proxy while the proxy is free.
+	std::vector<int> proxySlots;
+	int freeProxy;
+};
@@ -0,0 +1,339 @@
+#include "LooseOctree.h"
+#include <algorithm>
+
+static const int kNullIndex = -1;
+
+/// OctreeItem::node value of items kept in the fallback list.
+static const int kOutsideRoot = -2;
+
+/// Returns the AABB spanning halfSize on each side of center.
+static AABB CubeAround(Vector3 center, float halfSize) {
+	AABB cube;
+	cube.vecmin = _mm_set_ps(0, center.z - halfSize, center.y - halfSize, center.x - halfSize);
+	cube.vecmax = _mm_set_ps(0, center.z + halfSize, center.y + halfSize, center.x + halfSize);
+	return cube;
+}
+
+LooseOctree::LooseOctree(Vector3 center, Vector3 size, int maxDepth, float looseness) :
+	freeItem(kNullIndex), outsideHead(kNullIndex), outsideCount(0), rootCenter(center) {
+	rootHalfSize = std::max(size.x, std::max(size.y, size.z)) * 0.5f;
+	this->maxDepth = std::min(std::max(maxDepth, 0), kMaxOctreeDepth);
+	this->looseness = std::max(looseness, 1.0f);
+	nodes.resize(1);
+	InitNode(0, rootCenter, rootHalfSize, 0, kNullIndex);
+};
+
+void LooseOctree::InitNode(int node, Vector3 center, float halfSize, int depth, int parent) {
+	OctreeNode& octreeNode = nodes[node];
+	octreeNode.looseBounds = CubeAround(center, halfSize * looseness);
+	octreeNode.center = center;
+	octreeNode.halfSize = halfSize;
+	octreeNode.depth = depth;
+	octreeNode.parent = parent;
+	octreeNode.firstChild = kNullIndex;
+	octreeNode.firstItem = kNullIndex;
+	octreeNode.itemCount = 0;
+	octreeNode.subtreeCount = 0;
+};
+
+/// Allocates eight children for node from the pool.
+void LooseOctree::Split(int node) {
+	int block;
+	if (!freeBlocks.empty()) {
+		block = freeBlocks.back();
+		freeBlocks.pop_back();
+	}
+	else {
+		block = (int)nodes.size();
+		nodes.resize(nodes.size() + 8);
+	}
+	Vector3 center = nodes[node].center;
+	float childHalfSize = nodes[node].halfSize * 0.5f;
+	int childDepth = nodes[node].depth + 1;
+	for (int i = 0; i < 8; i++) {
+		Vector3 childCenter(
+			center.x + ((i & 1) ? childHalfSize : -childHalfSize),
+			center.y + ((i & 2) ? childHalfSize : -childHalfSize),
+			center.z + ((i & 4) ? childHalfSize : -childHalfSize));
+		InitNode(block + i, childCenter, childHalfSize, childDepth, node);
+	}
+	nodes[node].firstChild = block;
+};
+
+/// Returns node's children, and theirs, to the pool.
+void LooseOctree::ReleaseChildren(int node) {
+	int block = nodes[node].firstChild;
+	for (int i = 0; i < 8; i++) {
+		if (nodes[block + i].firstChild != kNullIndex) {
+			ReleaseChildren(block + i);
+		}
+	}
+	freeBlocks.push_back(block);
+	nodes[node].firstChild = kNullIndex;
+};
+
+void LooseOctree::LinkItem(int item, int node) {
+	OctreeItem& octreeItem = items[item];
+	int& head = node == kOutsideRoot ? outsideHead : nodes[node].firstItem;
+	octreeItem.node = node;
+	octreeItem.prev = kNullIndex;
+	octreeItem.next = head;
+	if (head != kNullIndex) {
+		items[head].prev = item;
+	}
+	head = item;
+};
+
+/// Returns the octant of node holding the center of bounds if that child's loose bounds enclose bounds,
+/// or -1 if the item has to stay in node.
+int LooseOctree::FittingOctant(int node, const AABB& bounds) const {
+	const OctreeNode& octreeNode = nodes[node];
+	if (octreeNode.depth >= maxDepth) return kNullIndex;
+	float center[4];
+	_mm_storeu_ps(center, _mm_mul_ps(_mm_add_ps(bounds.vecmin, bounds.vecmax), _mm_set1_ps(0.5f)));
+	int octant = (center[0] >= octreeNode.center.x ? 1 : 0) |
+		(center[1] >= octreeNode.center.y ? 2 : 0) |
+		(center[2] >= octreeNode.center.z ? 4 : 0);
+	float childHalfSize = octreeNode.halfSize * 0.5f;
+	Vector3 childCenter(
+		octreeNode.center.x + ((octant & 1) ? childHalfSize : -childHalfSize),
+		octreeNode.center.y + ((octant & 2) ? childHalfSize : -childHalfSize),
+		octreeNode.center.z + ((octant & 4) ? childHalfSize : -childHalfSize));
+	return contains(CubeAround(childCenter, childHalfSize * looseness), bounds) ? octant : kNullIndex;
+};
+
+/// Links item into the deepest cell that can hold it, or into the fallback list.
+void LooseOctree::Place(int item) {
+	const AABB bounds = items[item].bounds;
+	if (!contains(nodes[0].looseBounds, bounds)) {
+		LinkItem(item, kOutsideRoot);
+		outsideCount++;
+		return;
+	}
+
+	// Descend towards the child whose cell holds the item's center for as long as that child's loose bounds
+	// still enclose the whole item.
+	int node = 0;
+	int octant;
+	while ((octant = FittingOctant(node, bounds)) != kNullIndex) {
+		if (nodes[node].firstChild == kNullIndex) {
+			Split(node);
+		}
+		node = nodes[node].firstChild + octant;
+	}
+
+	LinkItem(item, node);
+	nodes[node].itemCount++;
+	for (int n = node; n != kNullIndex; n = nodes[n].parent) {
+		nodes[n].subtreeCount++;
+	}
+};
+
+/// Unlinks item from its cell or the fallback list, and releases cells that became empty.
+void LooseOctree::Unplace(int item) {
+	OctreeItem& octreeItem = items[item];
+	int node = octreeItem.node;
+	if (octreeItem.prev != kNullIndex) {
+		items[octreeItem.prev].next = octreeItem.next;
+	}
+	else if (node == kOutsideRoot) {
+		outsideHead = octreeItem.next;
+	}
+	else {
+		nodes[node].firstItem = octreeItem.next;
+	}
+	if (octreeItem.next != kNullIndex) {
+		items[octreeItem.next].prev = octreeItem.prev;
+	}
+
+	if (node == kOutsideRoot) {
+		outsideCount--;
+		return;
+	}
+
+	nodes[node].itemCount--;
+	int emptyAncestor = kNullIndex;
+	for (int n = node; n != kNullIndex; n = nodes[n].parent) {
+		nodes[n].subtreeCount--;
+	}
+	for (int n = node; n != kNullIndex; n = nodes[n].parent) {
+		if (nodes[n].firstChild != kNullIndex && nodes[n].subtreeCount == nodes[n].itemCount) {
+			emptyAncestor = n;
+		}
+	}
+	if (emptyAncestor != kNullIndex) {
+		ReleaseChildren(emptyAncestor);
+	}
+};
+
+int LooseOctree::Insert(int itemId, const AABB& bounds) {
+	int item;
+	if (freeItem != kNullIndex) {
+		item = freeItem;
+		freeItem = items[item].next;
+	}
+	else {
+		item = (int)items.size();
+		items.push_back(OctreeItem());
+	}
+	items[item].bounds = bounds;
+	items[item].itemId = itemId;
+	Place(item);
+	return item;
+};
+
+/// Moves the item behind proxy to new bounds. The item is only relinked if a fresh insert would put it in a
+/// different cell.
+void LooseOctree::Update(int proxy, const AABB& bounds) {
+	OctreeItem& octreeItem = items[proxy];
+	octreeItem.bounds = bounds;
+	int node = octreeItem.node;
+	if (node == kOutsideRoot) {
+		if (!contains(nodes[0].looseBounds, bounds)) return;
+	}
+	else if (contains(nodes[node].looseBounds, bounds) && FittingOctant(node, bounds) == kNullIndex) {
+		return;
+	}
+	Unplace(proxy);
+	Place(proxy);
+};
+
+void LooseOctree::Remove(int proxy) {
+	Unplace(proxy);
+	items[proxy].node = kNullIndex;
+	items[proxy].next = freeItem;
+	freeItem = proxy;
+};
+
+void LooseOctree::Clear() {
+	nodes.resize(1);
+	InitNode(0, rootCenter, rootHalfSize, 0, kNullIndex);
+	freeBlocks.clear();
+	items.clear();
+	freeItem = kNullIndex;
+	outsideHead = kNullIndex;
+	outsideCount = 0;
+};
+
+/// Returns the number of items in the fallback list.
+int LooseOctree::GetOutsideCount() const {
+	return outsideCount;
+};
+
+int LooseOctree::ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	for (int item = outsideHead; item != kNullIndex; item = items[item].next) {
+		if (contains(testBounds, items[item].bounds)) {
+			returnArray[curNumResults] = items[item].itemId;
+			curNumResults++;
+			if (curNumResults >= returnArrayMaxSize) return curNumResults;
+		}
+	}
+
+	// Cells whose loose bounds are fully contained are pushed complemented, and their items are reported
+	// without testing.
+	int stack[8 * (kMaxOctreeDepth + 1)];
+	int stackSize = 0;
+	if (nodes[0].subtreeCount > 0) {
+		stack[stackSize++] = 0;
+	}
+	while (stackSize > 0) {
+		int index = stack[--stackSize];
+		bool inside = index < 0;
+		const OctreeNode& node = nodes[inside ? ~index : index];
+		if (!inside) {
+			if (!intersects(testBounds, node.looseBounds)) continue;
+			inside = contains(testBounds, node.looseBounds) != 0;
+		}
+		for (int item = node.firstItem; item != kNullIndex; item = items[item].next) {
+			if (inside || contains(testBounds, items[item].bounds)) {
+				returnArray[curNumResults] = items[item].itemId;
+				curNumResults++;
+				if (curNumResults >= returnArrayMaxSize) return curNumResults;
+			}
+		}
+		if (node.firstChild != kNullIndex) {
+			for (int child = node.firstChild; child < node.firstChild + 8; child++) {
+				if (nodes[child].subtreeCount > 0) {
+					stack[stackSize++] = inside ? ~child : child;
+				}
+			}
+		}
+	}
+	return curNumResults;
+};
+
+int LooseOctree::IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	for (int item = outsideHead; item != kNullIndex; item = items[item].next) {
+		if (intersects(testBounds, items[item].bounds)) {
+			returnArray[curNumResults] = items[item].itemId;
+			curNumResults++;
+			if (curNumResults >= returnArrayMaxSize) return curNumResults;
+		}
+	}
+
+	int stack[8 * (kMaxOctreeDepth + 1)];
+	int stackSize = 0;
+	if (nodes[0].subtreeCount > 0) {
+		stack[stackSize++] = 0;
+	}
+	while (stackSize > 0) {
+		int index = stack[--stackSize];
+		bool inside = index < 0;
+		const OctreeNode& node = nodes[inside ? ~index : index];
+		if (!inside) {
+			if (!intersects(testBounds, node.looseBounds)) continue;
+			inside = contains(testBounds, node.looseBounds) != 0;
+		}
+		for (int item = node.firstItem; item != kNullIndex; item = items[item].next) {
+			if (inside || intersects(testBounds, items[item].bounds)) {
+				returnArray[curNumResults] = items[item].itemId;
+				curNumResults++;
+				if (curNumResults >= returnArrayMaxSize) return curNumResults;
+			}
+		}
+		if (node.firstChild != kNullIndex) {
+			for (int child = node.firstChild; child < node.firstChild + 8; child++) {
+				if (nodes[child].subtreeCount > 0) {
+					stack[stackSize++] = inside ? ~child : child;
+				}
+			}
+		}
+	}
+	return curNumResults;
+};
+
+void LooseOctree::Traverse(SpatialVisitor& visitor) const {
+	for (int item = outsideHead; item != kNullIndex; item = items[item].next) {
+		SpatialOverlap overlap = visitor.Classify(items[item].bounds);
+		if (overlap != SPATIAL_OUTSIDE && !visitor.Visit(items[item].itemId, items[item].bounds, overlap)) return;
+	}
+
+	int stack[8 * (kMaxOctreeDepth + 1)];
+	int stackSize = 0;
+	if (nodes[0].subtreeCount > 0) {
+		stack[stackSize++] = 0;
+	}
+	while (stackSize > 0) {
+		int index = stack[--stackSize];
+		bool inside = index < 0;
+		const OctreeNode& node = nodes[inside ? ~index : index];
+		if (!inside) {
+			SpatialOverlap overlap = visitor.Classify(node.looseBounds);
+			if (overlap == SPATIAL_OUTSIDE) continue;
+			inside = overlap == SPATIAL_INSIDE;
+		}
+		for (int item = node.firstItem; item != kNullIndex; item = items[item].next) {
+			SpatialOverlap overlap = inside ? SPATIAL_INSIDE : visitor.Classify(items[item].bounds);
+			if (overlap != SPATIAL_OUTSIDE && !visitor.Visit(items[item].itemId, items[item].bounds, overlap)) return;
+		}
+		if (node.firstChild != kNullIndex) {
+			for (int child = node.firstChild; child < node.firstChild + 8; child++) {
+				if (nodes[child].subtreeCount > 0) {
+					stack[stackSize++] = inside ? ~child : child;
+				}
+			}
+		}
+	}
+};
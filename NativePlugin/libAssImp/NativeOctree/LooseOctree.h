@@ -0,0 +1,85 @@
+#pragma once
+#include "AABB.h"
+#include "SpatialIndex.h"
+#include <vector>
+
+/// Deepest octree level a LooseOctree can be configured with.
+static const int kMaxOctreeDepth = 10;
+
+/// A cell of the LooseOctree. Children are allocated eight at a time from the octree's node pool.
+struct OctreeNode {
+	/// The cell's bounds scaled by the looseness factor around its center.
+	AABB looseBounds;
+	Vector3 center;
+	/// Half the side length of the cell before loosening.
+	float halfSize;
+	int depth;
+	int parent;
+	/// Index of the first of eight contiguous children in the node pool, or -1 for leaves.
+	int firstChild;
+	/// Head of the intrusive list of items stored directly in this cell.
+	int firstItem;
+	int itemCount;
+	/// Items stored in this cell and all cells below it.
+	int subtreeCount;
+};
+
+/// An item of the LooseOctree, linked into the item list of the cell it lives in.
+struct OctreeItem {
+	AABB bounds;
+	int itemId;
+	/// The cell the item lives in, kOutsideRoot for the fallback list, or -1 while the slot is free.
+	int node;
+	int prev;
+	int next;
+};
+
+/// Loose octree over a fixed world volume. Each item is stored in the deepest cell whose loose bounds
+/// still enclose it, chosen from the item's size and center, so an item lives in exactly one cell and can
+/// move within its cell's slack without being relinked. Items outside the root's loose bounds are kept in
+/// a fallback list that every query scans.
+class LooseOctree : public SpatialIndex {
+public:
+	/// Creates an octree covering the cube that encloses the box of the given center and size. Cells'
+	/// bounds are scaled by looseness, which must be at least 1.
+	LooseOctree(Vector3 center, Vector3 size, int maxDepth = 6, float looseness = 2.0f);
+	~LooseOctree() {};
+
+	int Insert(int itemId, const AABB& bounds) override;
+	void Update(int proxy, const AABB& bounds) override;
+	void Remove(int proxy) override;
+	void Clear() override;
+	int ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	int IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	void Traverse(SpatialVisitor& visitor) const override;
+
+	/// Returns the number of items in the fallback list.
+	int GetOutsideCount() const;
+
+private:
+	/// Returns the octant of node holding the center of bounds if that child's loose bounds enclose bounds,
+	/// or -1 if the item has to stay in node.
+	int FittingOctant(int node, const AABB& bounds) const;
+	/// Links item into the deepest cell that can hold it, or into the fallback list.
+	void Place(int item);
+	/// Unlinks item from its cell or the fallback list, and releases cells that became empty.
+	void Unplace(int item);
+	void LinkItem(int item, int node);
+	/// Allocates eight children for node from the pool.
+	void Split(int node);
+	/// Returns node's children, and theirs, to the pool.
+	void ReleaseChildren(int node);
+	void InitNode(int node, Vector3 center, float halfSize, int depth, int parent);
+
+	std::vector<OctreeNode> nodes;
+	/// Indices of released blocks of eight children, ready for reuse.
+	std::vector<int> freeBlocks;
+	std::vector<OctreeItem> items;
+	int freeItem;
+	int outsideHead;
+	int outsideCount;
+	Vector3 rootCenter;
+	float rootHalfSize;
+	int maxDepth;
+	float looseness;
+};
@@ -0,0 +1,89 @@
+#include "OverlapPairs.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+/// Sweep positions handled per chunk. The thread pool shares chunks out a few at a time, so a thread stuck on
+/// a dense cluster doesn't hold up the others.
+static const int kPairChunkSize = 1024;
+
+namespace {
+	/// A box's extent along the sweep axis and its position in the input.
+	struct SweepEntry {
+		float min;
+		float max;
+		int box;
+	};
+
+	bool SweepLess(const SweepEntry& a, const SweepEntry& b) {
+		return a.min < b.min;
+	}
+
+	/// The boxes in sweep order, and the pairs found by each chunk of it.
+	struct PairSweep {
+		std::vector<SweepEntry> entries;
+		std::vector<AABB> sorted;
+		std::vector<std::vector<int> > chunkPairs;
+
+		/// Tests each box in chunks first up to last against the boxes that start before it ends along the
+		/// sweep axis.
+		void Run(int first, int last) {
+			int count = (int)entries.size();
+			for (int chunk = first; chunk < last; chunk++) {
+				std::vector<int>& pairs = chunkPairs[chunk];
+				int end = std::min((chunk + 1) * kPairChunkSize, count);
+				for (int i = chunk * kPairChunkSize; i < end; i++) {
+					float reach = entries[i].max;
+					int id = IdFromAABB(sorted[i]);
+					for (int j = i + 1; j < count && entries[j].min <= reach; j++) {
+						if (!intersects(sorted[i], sorted[j])) continue;
+						int other = IdFromAABB(sorted[j]);
+						pairs.push_back(std::min(id, other));
+						pairs.push_back(std::max(id, other));
+					}
+				}
+			}
+		}
+	};
+}
+
+/// Appends every pair of intersecting boxes to pairs as two consecutive item ids, lower id first, using a sweep
+/// along x.
+void FindOverlappingPairs(const AABB* boxes, int count, std::vector<int>& pairs) {
+	if (count < 2) return;
+
+	PairSweep sweep;
+	sweep.entries.resize(count);
+	for (int i = 0; i < count; i++) {
+		float boundsMin[4];
+		float boundsMax[4];
+		_mm_storeu_ps(boundsMin, boxes[i].vecmin);
+		_mm_storeu_ps(boundsMax, boxes[i].vecmax);
+		sweep.entries[i].min = boundsMin[0];
+		sweep.entries[i].max = boundsMax[0];
+		sweep.entries[i].box = i;
+	}
+	std::sort(sweep.entries.begin(), sweep.entries.end(), SweepLess);
+	sweep.sorted.resize(count);
+	for (int i = 0; i < count; i++) {
+		sweep.sorted[i] = boxes[sweep.entries[i].box];
+	}
+	int chunkCount = (count + kPairChunkSize - 1) / kPairChunkSize;
+	sweep.chunkPairs.resize(chunkCount);
+
+	ThreadPool& pool = ThreadPool::Instance();
+	if (pool.RunsInParallel(count)) {
+		pool.ParallelFor(chunkCount, 1, [&sweep](int first, int last) { sweep.Run(first, last); });
+	}
+	else {
+		sweep.Run(0, chunkCount);
+	}
+
+	size_t total = pairs.size();
+	for (size_t chunk = 0; chunk < sweep.chunkPairs.size(); chunk++) {
+		total += sweep.chunkPairs[chunk].size();
+	}
+	pairs.reserve(total);
+	for (size_t chunk = 0; chunk < sweep.chunkPairs.size(); chunk++) {
+		pairs.insert(pairs.end(), sweep.chunkPairs[chunk].begin(), sweep.chunkPairs[chunk].end());
+	}
+};
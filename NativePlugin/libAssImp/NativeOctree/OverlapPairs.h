@@ -0,0 +1,8 @@
+#pragma once
+#include "AABB.h"
+#include <vector>
+
+/// Appends every pair of intersecting boxes to pairs as two consecutive item ids, lower id first, using a sweep
+/// along x. Enough boxes split the sweep into chunks shared out on the thread pool. Pairs come out in the same
+/// order for the same boxes whatever the thread count.
+void FindOverlappingPairs(const AABB* boxes, int count, std::vector<int>& pairs);
@@ -0,0 +1,229 @@
+#include "QuantizedScan.h"
+#include "ScanKernels.h"
+#include <cmath>
+#include <emmintrin.h> //SSE2
+
+static const int kNullIndex = -1;
+
+/// Largest quantized coordinate, before biasing.
+static const int kQuantizedMax = 65535;
+
+/// Subtracted from quantized coordinates so unsigned order becomes signed order.
+static const int kQuantizedBias = 0x8000;
+
+QuantizedScan::QuantizedScan(Vector3 worldCenter, Vector3 worldSize) : freeProxy(kNullIndex) {
+	float center[3] = { worldCenter.x, worldCenter.y, worldCenter.z };
+	float size[3] = { worldSize.x, worldSize.y, worldSize.z };
+	bool degenerate = false;
+	for (int axis = 0; axis < 3; axis++) {
+		worldMin[axis] = center[axis] - size[axis] * 0.5f;
+		degenerate = degenerate || !(size[axis] > 0);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		scale[axis] = degenerate ? 0 : kQuantizedMax / (double)size[axis];
+	}
+};
+
+/// The mapping never decreases as value grows, which is all the filter needs to stay conservative.
+int16_t QuantizedScan::Quantize(int axis, float value, bool roundUp) const {
+	double scaled = ((double)value - worldMin[axis]) * scale[axis];
+	scaled = roundUp ? std::ceil(scaled) : std::floor(scaled);
+	int quantized = !(scaled > 0) ? 0 : !(scaled < kQuantizedMax) ? kQuantizedMax : (int)scaled;
+	return (int16_t)(quantized - kQuantizedBias);
+};
+
+void QuantizedScan::Store(int slot, const AABB& bounds) {
+	float boundsMin[4];
+	float boundsMax[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	_mm_storeu_ps(boundsMax, bounds.vecmax);
+	minX[slot] = Quantize(0, boundsMin[0], false);
+	minY[slot] = Quantize(1, boundsMin[1], false);
+	minZ[slot] = Quantize(2, boundsMin[2], false);
+	maxX[slot] = Quantize(0, boundsMax[0], true);
+	maxY[slot] = Quantize(1, boundsMax[1], true);
+	maxZ[slot] = Quantize(2, boundsMax[2], true);
+	exact[slot] = bounds;
+};
+
+int QuantizedScan::Insert(int itemId, const AABB& bounds) {
+	int proxy;
+	if (freeProxy != kNullIndex) {
+		proxy = freeProxy;
+		freeProxy = proxySlots[proxy];
+	}
+	else {
+		proxy = (int)proxySlots.size();
+		proxySlots.push_back(kNullIndex);
+	}
+	int slot = (int)ids.size();
+	proxySlots[proxy] = slot;
+	minX.push_back(0);
+	minY.push_back(0);
+	minZ.push_back(0);
+	maxX.push_back(0);
+	maxY.push_back(0);
+	maxZ.push_back(0);
+	ids.push_back(itemId);
+	exact.push_back(bounds);
+	slotProxies.push_back(proxy);
+	Store(slot, bounds);
+	return proxy;
+};
+
+void QuantizedScan::Update(int proxy, const AABB& bounds) {
+	Store(proxySlots[proxy], bounds);
+};
+
+void QuantizedScan::Remove(int proxy) {
+	int slot = proxySlots[proxy];
+	int last = (int)ids.size() - 1;
+	if (slot != last) {
+		minX[slot] = minX[last];
+		minY[slot] = minY[last];
+		minZ[slot] = minZ[last];
+		maxX[slot] = maxX[last];
+		maxY[slot] = maxY[last];
+		maxZ[slot] = maxZ[last];
+		ids[slot] = ids[last];
+		exact[slot] = exact[last];
+		slotProxies[slot] = slotProxies[last];
+		proxySlots[slotProxies[slot]] = slot;
+	}
+	minX.pop_back();
+	minY.pop_back();
+	minZ.pop_back();
+	maxX.pop_back();
+	maxY.pop_back();
+	maxZ.pop_back();
+	ids.pop_back();
+	exact.pop_back();
+	slotProxies.pop_back();
+	proxySlots[proxy] = freeProxy;
+	freeProxy = proxy;
+};
+
+void QuantizedScan::Clear() {
+	minX.clear();
+	minY.clear();
+	minZ.clear();
+	maxX.clear();
+	maxY.clear();
+	maxZ.clear();
+	ids.clear();
+	exact.clear();
+	slotProxies.clear();
+	proxySlots.clear();
+	freeProxy = kNullIndex;
+};
+
+/// Hands the slot of every item lying inside testBounds, or intersecting it if contained isn't set, to emit
+/// until emit returns false. Items are filtered on their quantized bounds eight at a time, and only the
+/// candidates are tested against their exact bounds.
+template <typename Emit>
+void QuantizedScan::ForEachMatch(const AABB& testBounds, bool contained, Emit& emit) const {
+	float testMin[4];
+	float testMax[4];
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+	int16_t quantizedMin[3];
+	int16_t quantizedMax[3];
+	for (int axis = 0; axis < 3; axis++) {
+		quantizedMin[axis] = Quantize(axis, testMin[axis], false);
+		quantizedMax[axis] = Quantize(axis, testMax[axis], true);
+	}
+
+	// A contained item has its quantized min at or above the test box's rounded down min, and its quantized
+	// max at or below the test box's rounded up max. An intersecting item has its quantized max at or above
+	// the rounded down min, and its quantized min at or below the rounded up max.
+	size_t count = ids.size();
+	size_t i = 0;
+	__m128i testMinX = _mm_set1_epi16(quantizedMin[0]);
+	__m128i testMinY = _mm_set1_epi16(quantizedMin[1]);
+	__m128i testMinZ = _mm_set1_epi16(quantizedMin[2]);
+	__m128i testMaxX = _mm_set1_epi16(quantizedMax[0]);
+	__m128i testMaxY = _mm_set1_epi16(quantizedMax[1]);
+	__m128i testMaxZ = _mm_set1_epi16(quantizedMax[2]);
+	for (; i + 8 <= count; i += 8) {
+		__m128i itemMinX = _mm_loadu_si128((const __m128i*)&minX[i]);
+		__m128i itemMinY = _mm_loadu_si128((const __m128i*)&minY[i]);
+		__m128i itemMinZ = _mm_loadu_si128((const __m128i*)&minZ[i]);
+		__m128i itemMaxX = _mm_loadu_si128((const __m128i*)&maxX[i]);
+		__m128i itemMaxY = _mm_loadu_si128((const __m128i*)&maxY[i]);
+		__m128i itemMaxZ = _mm_loadu_si128((const __m128i*)&maxZ[i]);
+		__m128i miss;
+		if (contained) {
+			miss = _mm_or_si128(_mm_cmpgt_epi16(testMinX, itemMinX), _mm_cmplt_epi16(testMaxX, itemMaxX));
+			miss = _mm_or_si128(miss, _mm_or_si128(_mm_cmpgt_epi16(testMinY, itemMinY), _mm_cmplt_epi16(testMaxY, itemMaxY)));
+			miss = _mm_or_si128(miss, _mm_or_si128(_mm_cmpgt_epi16(testMinZ, itemMinZ), _mm_cmplt_epi16(testMaxZ, itemMaxZ)));
+		}
+		else {
+			miss = _mm_or_si128(_mm_cmplt_epi16(testMaxX, itemMinX), _mm_cmpgt_epi16(testMinX, itemMaxX));
+			miss = _mm_or_si128(miss, _mm_or_si128(_mm_cmplt_epi16(testMaxY, itemMinY), _mm_cmpgt_epi16(testMinY, itemMaxY)));
+			miss = _mm_or_si128(miss, _mm_or_si128(_mm_cmplt_epi16(testMaxZ, itemMinZ), _mm_cmpgt_epi16(testMinZ, itemMaxZ)));
+		}
+		// Narrow the 16-bit lane masks to bytes so movemask yields one bit per item.
+		unsigned int candidates = ~(unsigned int)_mm_movemask_epi8(_mm_packs_epi16(miss, miss)) & 0xFF;
+		while (candidates != 0) {
+			size_t slot = i + LowestBit(candidates);
+			candidates &= candidates - 1;
+			if (contained ? contains(testBounds, exact[slot]) : intersects(testBounds, exact[slot])) {
+				if (!emit(slot)) return;
+			}
+		}
+	}
+	for (; i < count; i++) {
+		bool miss = contained ?
+			quantizedMin[0] > minX[i] || quantizedMax[0] < maxX[i] ||
+			quantizedMin[1] > minY[i] || quantizedMax[1] < maxY[i] ||
+			quantizedMin[2] > minZ[i] || quantizedMax[2] < maxZ[i] :
+			quantizedMax[0] < minX[i] || quantizedMin[0] > maxX[i] ||
+			quantizedMax[1] < minY[i] || quantizedMin[1] > maxY[i] ||
+			quantizedMax[2] < minZ[i] || quantizedMin[2] > maxZ[i];
+		if (miss) continue;
+		if (contained ? contains(testBounds, exact[i]) : intersects(testBounds, exact[i])) {
+			if (!emit(i)) return;
+		}
+	}
+};
+
+int QuantizedScan::ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	auto emit = [&](size_t slot) {
+		returnArray[curNumResults] = ids[slot];
+		curNumResults++;
+		return curNumResults < returnArrayMaxSize;
+	};
+	ForEachMatch(testBounds, true, emit);
+	return curNumResults;
+};
+
+int QuantizedScan::IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	auto emit = [&](size_t slot) {
+		returnArray[curNumResults] = ids[slot];
+		curNumResults++;
+		return curNumResults < returnArrayMaxSize;
+	};
+	ForEachMatch(testBounds, false, emit);
+	return curNumResults;
+};
+
+/// Classifies the items intersecting the visitor's bounds.
+void QuantizedScan::Traverse(SpatialVisitor& visitor) const {
+	auto emit = [&](size_t slot) {
+		SpatialOverlap overlap = visitor.Classify(exact[slot]);
+		return overlap == SPATIAL_OUTSIDE || visitor.Visit(ids[slot], exact[slot], overlap);
+	};
+	ForEachMatch(visitor.Bounds(), false, emit);
+};
+
+int QuantizedScan::Count(const AABB& testBounds, bool contained, int maxCount) const {
+	int count = 0;
+	auto emit = [&](size_t slot) {
+		count++;
+		return count < maxCount;
+	};
+	ForEachMatch(testBounds, contained, emit);
+	return count;
+};
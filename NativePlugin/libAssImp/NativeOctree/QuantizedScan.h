@@ -0,0 +1,56 @@
+#pragma once
+#include "AABB.h"
+#include "SpatialIndex.h"
+#include <cstdint>
+#include <vector>
+
+/// Linear scan over item bounds quantized to 16 bits per coordinate relative to the world volume, rounded
+/// outward so the quantized boxes always enclose the real ones. Queries filter on the quantized bounds, eight
+/// items per SSE2 instruction at half the memory traffic of float bounds, and test only the candidates against
+/// the exact bounds, so results match the float scans exactly. Items reaching outside the world volume are
+/// clamped to its faces, which keeps the filter conservative but lets more of them through.
+class QuantizedScan : public SpatialIndex {
+public:
+	/// Creates an index quantizing bounds over the box of the given center and size. A size that isn't
+	/// positive on every axis leaves nothing to quantize against, and every item becomes a candidate.
+	QuantizedScan(Vector3 worldCenter, Vector3 worldSize);
+	~QuantizedScan() {};
+
+	int Insert(int itemId, const AABB& bounds) override;
+	void Update(int proxy, const AABB& bounds) override;
+	void Remove(int proxy) override;
+	void Clear() override;
+	int ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	int IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	void Traverse(SpatialVisitor& visitor) const override;
+	int Count(const AABB& testBounds, bool contained, int maxCount) const override;
+
+private:
+	/// Hands the slot of every item lying inside testBounds, or intersecting it if contained isn't set, to emit
+	/// until emit returns false.
+	template <typename Emit>
+	void ForEachMatch(const AABB& testBounds, bool contained, Emit& emit) const;
+	/// Writes the quantized bounds of the item at slot.
+	void Store(int slot, const AABB& bounds);
+	/// Quantizes value on axis, rounding down or up, clamps it to the grid and biases it for signed compares.
+	int16_t Quantize(int axis, float value, bool roundUp) const;
+
+	/// Quantized bounds, biased by -0x8000 so SSE2's signed 16-bit compares order them correctly.
+	std::vector<int16_t> minX;
+	std::vector<int16_t> minY;
+	std::vector<int16_t> minZ;
+	std::vector<int16_t> maxX;
+	std::vector<int16_t> maxY;
+	std::vector<int16_t> maxZ;
+	/// Item id, exact bounds and proxy of each item, parallel to the quantized bounds. The exact bounds are
+	/// only read for candidates.
+	std::vector<int> ids;
+	std::vector<AABB> exact;
+	std::vector<int> slotProxies;
+	/// Slot of each proxy's item, or the next free proxy while the proxy is free.
+	std::vector<int> proxySlots;
+	int freeProxy;
+	float worldMin[3];
+	/// Quantization steps per unit on each axis, or 0 if the world volume is degenerate.
+	double scale[3];
+};
@@ -0,0 +1,515 @@
+#include "QueryShapes.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+/// Returns the largest of the x, y and z lanes of v.
+static inline float MaxOf3(__m128 v) {
+	v = _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 2, 1, 0));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(v);
+}
+
+/// Returns the smallest of the x, y and z lanes of v.
+static inline float MinOf3(__m128 v) {
+	v = _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 2, 1, 0));
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(v);
+}
+
+/// Returns the sum of the x, y and z lanes of v.
+static inline float SumOf3(__m128 v) {
+	__m128 yz = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 1));
+	__m128 z = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+	return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(v, yz), z));
+}
+
+/// Returns v with its x, y and z lanes rotated by one, so lane j holds lane j + 1.
+static inline __m128 RotateNext(__m128 v) {
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+/// Returns v with its x, y and z lanes rotated by two, so lane j holds lane j + 2.
+static inline __m128 RotateLast(__m128 v) {
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2));
+}
+
+/// Returns the absolute value of every lane of v.
+static inline __m128 Absolute(__m128 v) {
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+/// Returns whether any of the x, y and z lanes of a is greater than the same lane of b.
+static inline bool AnyGreater3(__m128 a, __m128 b) {
+	return (_mm_movemask_ps(_mm_cmpgt_ps(a, b)) & 7) != 0;
+}
+
+/// Returns the squared distance from point to bounds: the gap to the box on each axis, or 0 on the axes where
+/// the point lies within the box's extent.
+static inline float PointBoxDistanceSquared(__m128 point, const AABB& bounds) {
+	__m128 below = _mm_sub_ps(bounds.vecmin, point);
+	__m128 above = _mm_sub_ps(point, bounds.vecmax);
+	__m128 gap = _mm_max_ps(_mm_max_ps(below, above), _mm_setzero_ps());
+	return SumOf3(_mm_mul_ps(gap, gap));
+}
+
+/// Returns the squared distance from point to the farthest corner of bounds.
+static inline float PointBoxFarthestSquared(__m128 point, const AABB& bounds) {
+	__m128 below = _mm_sub_ps(point, bounds.vecmin);
+	__m128 above = _mm_sub_ps(bounds.vecmax, point);
+	__m128 reach = _mm_max_ps(_mm_mul_ps(below, below), _mm_mul_ps(above, above));
+	return SumOf3(reach);
+}
+
+NearestHits::NearestHits(float maxDistance, int maxCount) : maxDistance(maxDistance), maxCount(maxCount) {
+	heap.reserve(std::max(std::min(maxCount, 1024), 0));
+};
+
+bool NearestHits::Closer(const Hit& a, const Hit& b) {
+	return a.distance < b.distance || (a.distance == b.distance && a.itemId < b.itemId);
+};
+
+float NearestHits::MaxDistance() const {
+	return (int)heap.size() >= maxCount && maxCount > 0 ? heap.front().distance : maxDistance;
+};
+
+void NearestHits::Visit(int itemId, const AABB& bounds, float distance) {
+	if (maxCount <= 0) return;
+	Hit hit = { distance, itemId };
+	if ((int)heap.size() < maxCount) {
+		heap.push_back(hit);
+		std::push_heap(heap.begin(), heap.end(), Closer);
+	}
+	else if (Closer(hit, heap.front())) {
+		std::pop_heap(heap.begin(), heap.end(), Closer);
+		heap.back() = hit;
+		std::push_heap(heap.begin(), heap.end(), Closer);
+	}
+};
+
+/// Writes the ids, and the distances unless distanceArray is null, of the collected items closest first,
+/// and returns their count.
+int NearestHits::Write(int* idArray, float* distanceArray) {
+	std::sort_heap(heap.begin(), heap.end(), Closer);
+	for (size_t i = 0; i < heap.size(); i++) {
+		idArray[i] = heap[i].itemId;
+		if (distanceArray != nullptr) {
+			distanceArray[i] = heap[i].distance;
+		}
+	}
+	int count = (int)heap.size();
+	heap.clear();
+	return count;
+};
+
+RayQuery::RayQuery(Vector3 origin, Vector3 direction, float maxDistance, int maxHits) :
+	NearestHits(maxDistance, maxHits) {
+	float start[3] = { origin.x, origin.y, origin.z };
+	float step[3] = { direction.x, direction.y, direction.z };
+	length = std::sqrt(step[0] * step[0] + step[1] * step[1] + step[2] * step[2]);
+	if (!(length > 0) || !(maxDistance >= 0)) {
+		// Nothing is hit, and an inverted box overlaps nothing.
+		length = 0;
+		this->origin = _mm_setzero_ps();
+		inverseDirection = _mm_setzero_ps();
+		bounds.vecmin = _mm_set1_ps(FLT_MAX);
+		bounds.vecmax = _mm_set1_ps(-FLT_MAX);
+		return;
+	}
+
+	float inverse[3];
+	float boundsMin[3];
+	float boundsMax[3];
+	for (int axis = 0; axis < 3; axis++) {
+		step[axis] /= length;
+		inverse[axis] = step[axis] != 0 ? 1.0f / step[axis] : FLT_MAX;
+		inverse[axis] = std::min(std::max(inverse[axis], -FLT_MAX), FLT_MAX);
+		// An axis the ray doesn't move along would otherwise give 0 * infinity for an unbounded ray.
+		float end = step[axis] != 0 ? start[axis] + step[axis] * maxDistance : start[axis];
+		boundsMin[axis] = std::min(start[axis], end);
+		boundsMax[axis] = std::max(start[axis], end);
+	}
+	this->origin = _mm_set_ps(0, start[2], start[1], start[0]);
+	inverseDirection = _mm_set_ps(0, inverse[2], inverse[1], inverse[0]);
+	bounds.vecmin = _mm_set_ps(0, boundsMin[2], boundsMin[1], boundsMin[0]);
+	bounds.vecmax = _mm_set_ps(0, boundsMax[2], boundsMax[1], boundsMax[0]);
+};
+
+AABB RayQuery::Bounds() const {
+	return bounds;
+};
+
+/// Slab test of the ray against bounds, all three axes at once. The ray enters bounds at the last of its
+/// entries into the three slabs and leaves at the first exit.
+float RayQuery::Distance(const AABB& bounds) const {
+	if (length == 0) return -1;
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(bounds.vecmin, origin), inverseDirection);
+	__m128 t2 = _mm_mul_ps(_mm_sub_ps(bounds.vecmax, origin), inverseDirection);
+	float entry = std::max(MaxOf3(_mm_min_ps(t1, t2)), 0.0f);
+	float exit = std::min(MinOf3(_mm_max_ps(t1, t2)), MaxDistance());
+	return entry <= exit ? entry : -1;
+};
+
+PointQuery::PointQuery(Vector3 point, float maxDistance, int maxCount) :
+	NearestHits(maxDistance >= 0 ? maxDistance * maxDistance : -1, maxCount) {
+	this->point = _mm_set_ps(0, point.z, point.y, point.x);
+	// An infinite radius leaves an unbounded box, which the backends without a hierarchy scan in full.
+	__m128 radius = _mm_set1_ps(maxDistance >= 0 ? maxDistance : 0);
+	bounds.vecmin = _mm_sub_ps(this->point, radius);
+	bounds.vecmax = _mm_add_ps(this->point, radius);
+};
+
+AABB PointQuery::Bounds() const {
+	return bounds;
+};
+
+float PointQuery::Distance(const AABB& bounds) const {
+	return PointBoxDistanceSquared(point, bounds);
+};
+
+ShapeHits::ShapeHits(int* returnArray, int returnArrayMaxSize, int* overlapArray) :
+	returnArray(returnArray), overlapArray(overlapArray), returnArrayMaxSize(returnArrayMaxSize), curNumResults(0) {
+
+};
+
+bool ShapeHits::Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) {
+	if (curNumResults >= returnArrayMaxSize) return false;
+	returnArray[curNumResults] = itemId;
+	if (overlapArray != nullptr) {
+		overlapArray[curNumResults] = overlap;
+	}
+	curNumResults++;
+	return curNumResults < returnArrayMaxSize;
+};
+
+/// Returns the number of ids written.
+int ShapeHits::Count() const {
+	return curNumResults;
+};
+
+SphereQuery::SphereQuery(Vector3 center, float radius, int* returnArray, int returnArrayMaxSize) :
+	ShapeHits(returnArray, returnArrayMaxSize) {
+	this->center = _mm_set_ps(0, center.z, center.y, center.x);
+	// A negative radius overlaps nothing: its square is replaced by -1, and its bounds come out inverted.
+	radiusSquared = radius >= 0 ? radius * radius : -1;
+	__m128 reach = _mm_set1_ps(radius);
+	bounds.vecmin = _mm_sub_ps(this->center, reach);
+	bounds.vecmax = _mm_add_ps(this->center, reach);
+};
+
+AABB SphereQuery::Bounds() const {
+	return bounds;
+};
+
+/// Intersecting if the box comes within radius of the center, and inside if its farthest corner does.
+SpatialOverlap SphereQuery::Classify(const AABB& bounds) const {
+	if (PointBoxDistanceSquared(center, bounds) > radiusSquared) return SPATIAL_OUTSIDE;
+	return PointBoxFarthestSquared(center, bounds) <= radiusSquared ? SPATIAL_INSIDE : SPATIAL_INTERSECTING;
+};
+
+CapsuleQuery::CapsuleQuery(Vector3 start, Vector3 end, float radius, int* returnArray, int returnArrayMaxSize) :
+	ShapeHits(returnArray, returnArrayMaxSize), radius(radius) {
+	float step[3] = { end.x - start.x, end.y - start.y, end.z - start.z };
+	float inverse[3];
+	for (int axis = 0; axis < 3; axis++) {
+		inverse[axis] = step[axis] != 0 ? 1.0f / step[axis] : FLT_MAX;
+		inverse[axis] = std::min(std::max(inverse[axis], -FLT_MAX), FLT_MAX);
+	}
+	this->start = _mm_set_ps(0, start.z, start.y, start.x);
+	this->step = _mm_set_ps(0, step[2], step[1], step[0]);
+	inverseStep = _mm_set_ps(0, inverse[2], inverse[1], inverse[0]);
+	__m128 end4 = _mm_set_ps(0, end.z, end.y, end.x);
+	__m128 reach = _mm_set1_ps(radius);
+	bounds.vecmin = _mm_sub_ps(_mm_min_ps(this->start, end4), reach);
+	bounds.vecmax = _mm_add_ps(_mm_max_ps(this->start, end4), reach);
+};
+
+AABB CapsuleQuery::Bounds() const {
+	return bounds;
+};
+
+/// Returns the squared distance from the segment to bounds. The squared distance from a point on the segment
+/// to the box is convex and piecewise quadratic along the segment, with pieces ending where the point enters
+/// or leaves a slab of the box. The minimum of each piece is found in closed form and the least is returned.
+float CapsuleQuery::DistanceSquared(const AABB& bounds) const {
+	float boundsMin[4];
+	float boundsMax[4];
+	float origin[4];
+	float direction[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	_mm_storeu_ps(boundsMax, bounds.vecmax);
+	_mm_storeu_ps(origin, start);
+	_mm_storeu_ps(direction, step);
+
+	float breaks[8];
+	int breakCount = 0;
+	breaks[breakCount++] = 0;
+	breaks[breakCount++] = 1;
+	for (int axis = 0; axis < 3; axis++) {
+		if (direction[axis] == 0) continue;
+		float enter = (boundsMin[axis] - origin[axis]) / direction[axis];
+		float leave = (boundsMax[axis] - origin[axis]) / direction[axis];
+		if (enter > 0 && enter < 1) breaks[breakCount++] = enter;
+		if (leave > 0 && leave < 1) breaks[breakCount++] = leave;
+	}
+	for (int i = 1; i < breakCount; i++) {
+		for (int j = i; j > 0 && breaks[j] < breaks[j - 1]; j--) {
+			std::swap(breaks[j], breaks[j - 1]);
+		}
+	}
+
+	float best = FLT_MAX;
+	for (int i = 0; i + 1 < breakCount; i++) {
+		// On this piece each axis is either within the slab, contributing nothing, or on one side of it,
+		// contributing (origin + t * direction - face)^2.
+		float middle = 0.5f * (breaks[i] + breaks[i + 1]);
+		float slope = 0;
+		float curvature = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			float position = origin[axis] + middle * direction[axis];
+			float face = position < boundsMin[axis] ? boundsMin[axis] : position > boundsMax[axis] ? boundsMax[axis] : position;
+			if (face == position) continue;
+			slope += (origin[axis] - face) * direction[axis];
+			curvature += direction[axis] * direction[axis];
+		}
+		float t = curvature > 0 ? -slope / curvature : breaks[i];
+		t = std::min(std::max(t, breaks[i]), breaks[i + 1]);
+		__m128 point = _mm_add_ps(start, _mm_mul_ps(step, _mm_set1_ps(t)));
+		best = std::min(best, PointBoxDistanceSquared(point, bounds));
+	}
+	return best;
+};
+
+/// Culls with a slab test of the segment against the box grown by radius, then measures the exact distance
+/// from the segment to the box. Inside if all eight corners lie within the capsule.
+SpatialOverlap CapsuleQuery::Classify(const AABB& bounds) const {
+	if (!(radius >= 0)) return SPATIAL_OUTSIDE;
+	__m128 reach = _mm_set1_ps(radius);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(bounds.vecmin, reach), start), inverseStep);
+	__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(bounds.vecmax, reach), start), inverseStep);
+	float entry = std::max(MaxOf3(_mm_min_ps(t1, t2)), 0.0f);
+	float exit = std::min(MinOf3(_mm_max_ps(t1, t2)), 1.0f);
+	if (entry > exit) return SPATIAL_OUTSIDE;
+
+	float radiusSquared = radius * radius;
+	if (DistanceSquared(bounds) > radiusSquared) return SPATIAL_OUTSIDE;
+
+	// The capsule is convex, so a box is inside it when its corners are. Boxes wider than the capsule can't be.
+	__m128 size = _mm_sub_ps(bounds.vecmax, bounds.vecmin);
+	if (MaxOf3(size) > 2 * radius) return SPATIAL_INTERSECTING;
+	float stepLengthSquared = SumOf3(_mm_mul_ps(step, step));
+	for (int corner = 0; corner < 8; corner++) {
+		__m128 select = _mm_castsi128_ps(_mm_set_epi32(0, (corner & 4) ? -1 : 0, (corner & 2) ? -1 : 0, (corner & 1) ? -1 : 0));
+		__m128 point = _mm_or_ps(_mm_and_ps(select, bounds.vecmax), _mm_andnot_ps(select, bounds.vecmin));
+		__m128 offset = _mm_sub_ps(point, start);
+		float t = stepLengthSquared > 0 ? SumOf3(_mm_mul_ps(offset, step)) / stepLengthSquared : 0;
+		t = std::min(std::max(t, 0.0f), 1.0f);
+		__m128 gap = _mm_sub_ps(offset, _mm_mul_ps(step, _mm_set1_ps(t)));
+		if (SumOf3(_mm_mul_ps(gap, gap)) > radiusSquared) return SPATIAL_INTERSECTING;
+	}
+	return SPATIAL_INSIDE;
+};
+
+FrustumQuery::FrustumQuery(const float* planes, int* returnArray, int returnArrayMaxSize, int* overlapArray) :
+	ShapeHits(returnArray, returnArrayMaxSize, overlapArray) {
+	float components[4][8];
+	for (int plane = 0; plane < 8; plane++) {
+		bool spare = plane >= kFrustumPlanes;
+		for (int component = 0; component < 4; component++) {
+			components[component][plane] = spare ? (component == 3 ? 1.0f : 0.0f) : planes[plane * 4 + component];
+		}
+	}
+	__m128 zero = _mm_setzero_ps();
+	for (int group = 0; group < 2; group++) {
+		normalX[group] = _mm_loadu_ps(&components[0][group * 4]);
+		normalY[group] = _mm_loadu_ps(&components[1][group * 4]);
+		normalZ[group] = _mm_loadu_ps(&components[2][group * 4]);
+		distance[group] = _mm_loadu_ps(&components[3][group * 4]);
+		negativeX[group] = _mm_cmplt_ps(normalX[group], zero);
+		negativeY[group] = _mm_cmplt_ps(normalY[group], zero);
+		negativeZ[group] = _mm_cmplt_ps(normalZ[group], zero);
+	}
+};
+
+AABB FrustumQuery::Bounds() const {
+	AABB bounds;
+	bounds.vecmin = _mm_set1_ps(-INFINITY);
+	bounds.vecmax = _mm_set1_ps(INFINITY);
+	return bounds;
+};
+
+/// Tests the box corner farthest along and farthest against each plane's normal, for four planes at once. The
+/// box is outside if the corner farthest along some normal is behind that plane, and inside if the corner
+/// farthest against every normal is in front of its plane.
+SpatialOverlap FrustumQuery::Classify(const AABB& bounds) const {
+	float boundsMin[4];
+	float boundsMax[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	_mm_storeu_ps(boundsMax, bounds.vecmax);
+	__m128 minX = _mm_set1_ps(boundsMin[0]);
+	__m128 minY = _mm_set1_ps(boundsMin[1]);
+	__m128 minZ = _mm_set1_ps(boundsMin[2]);
+	__m128 maxX = _mm_set1_ps(boundsMax[0]);
+	__m128 maxY = _mm_set1_ps(boundsMax[1]);
+	__m128 maxZ = _mm_set1_ps(boundsMax[2]);
+	__m128 zero = _mm_setzero_ps();
+	bool intersecting = false;
+	for (int group = 0; group < 2; group++) {
+		// The corner farthest along a normal takes the max on the axes where the normal is positive, and the
+		// nearest corner the min.
+		__m128 nearX = _mm_or_ps(_mm_and_ps(negativeX[group], maxX), _mm_andnot_ps(negativeX[group], minX));
+		__m128 nearY = _mm_or_ps(_mm_and_ps(negativeY[group], maxY), _mm_andnot_ps(negativeY[group], minY));
+		__m128 nearZ = _mm_or_ps(_mm_and_ps(negativeZ[group], maxZ), _mm_andnot_ps(negativeZ[group], minZ));
+		__m128 farX = _mm_or_ps(_mm_and_ps(negativeX[group], minX), _mm_andnot_ps(negativeX[group], maxX));
+		__m128 farY = _mm_or_ps(_mm_and_ps(negativeY[group], minY), _mm_andnot_ps(negativeY[group], maxY));
+		__m128 farZ = _mm_or_ps(_mm_and_ps(negativeZ[group], minZ), _mm_andnot_ps(negativeZ[group], maxZ));
+		__m128 farSide = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[group], farX), _mm_mul_ps(normalY[group], farY)),
+			_mm_add_ps(_mm_mul_ps(normalZ[group], farZ), distance[group]));
+		if (_mm_movemask_ps(_mm_cmplt_ps(farSide, zero)) != 0) return SPATIAL_OUTSIDE;
+		__m128 nearSide = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[group], nearX), _mm_mul_ps(normalY[group], nearY)),
+			_mm_add_ps(_mm_mul_ps(normalZ[group], nearZ), distance[group]));
+		intersecting = intersecting || _mm_movemask_ps(_mm_cmplt_ps(nearSide, zero)) != 0;
+	}
+	return intersecting ? SPATIAL_INTERSECTING : SPATIAL_INSIDE;
+};
+
+/// Padding added to the absolute cosines used by the cross product axes.
+static const float kParallelEpsilon = 1e-6f;
+
+OrientedBoxQuery::OrientedBoxQuery(Vector3 center, Vector3 extents, const float* rotation, bool contained,
+	int* returnArray, int returnArrayMaxSize) : ShapeHits(returnArray, returnArrayMaxSize), contained(contained) {
+	float x = rotation[0];
+	float y = rotation[1];
+	float z = rotation[2];
+	float w = rotation[3];
+	float lengthSquared = x * x + y * y + z * z + w * w;
+	float scale = lengthSquared > 0 ? 2.0f / lengthSquared : 0;
+	// Columns of the rotation matrix are the box axes.
+	float axes[3][3] = {
+		{ 1 - scale * (y * y + z * z), scale * (x * y + w * z), scale * (x * z - w * y) },
+		{ scale * (x * y - w * z), 1 - scale * (x * x + z * z), scale * (y * z + w * x) },
+		{ scale * (x * z + w * y), scale * (y * z - w * x), 1 - scale * (x * x + y * y) },
+	};
+	for (int i = 0; i < 3; i++) {
+		rows[i] = _mm_set_ps(0, axes[2][i], axes[1][i], axes[0][i]);
+		absoluteRows[i] = Absolute(rows[i]);
+		paddedRows[i] = _mm_add_ps(absoluteRows[i], _mm_set1_ps(kParallelEpsilon));
+	}
+	this->center = _mm_set_ps(0, center.z, center.y, center.x);
+	this->extents = _mm_set_ps(0, extents.z, extents.y, extents.x);
+	extentsNext = RotateNext(this->extents);
+	extentsLast = RotateLast(this->extents);
+
+	// The box's reach along world axis i is the sum over its axes of extent times |cosine|.
+	float reach[3];
+	for (int i = 0; i < 3; i++) {
+		reach[i] = SumOf3(_mm_mul_ps(absoluteRows[i], this->extents));
+	}
+	this->reach = _mm_set_ps(0, reach[2], reach[1], reach[0]);
+	bounds.vecmin = _mm_sub_ps(this->center, this->reach);
+	bounds.vecmax = _mm_add_ps(this->center, this->reach);
+};
+
+AABB OrientedBoxQuery::Bounds() const {
+	return bounds;
+};
+
+/// Separating axis test of the oriented box against bounds: the three world axes, the three box axes and
+/// their nine cross products, each group of three tested at once. Inside if bounds projects within the
+/// oriented box on each of its axes.
+SpatialOverlap OrientedBoxQuery::Classify(const AABB& bounds) const {
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 boxCenter = _mm_mul_ps(_mm_add_ps(bounds.vecmin, bounds.vecmax), half);
+	__m128 boxExtents = _mm_mul_ps(_mm_sub_ps(bounds.vecmax, bounds.vecmin), half);
+	__m128 offset = _mm_sub_ps(center, boxCenter);
+	float offsets[4];
+	float boxReach[4];
+	_mm_storeu_ps(offsets, offset);
+	_mm_storeu_ps(boxReach, boxExtents);
+
+	// World axes: the oriented box reaches the sum of its extents times |cosine| along each.
+	if (AnyGreater3(Absolute(offset), _mm_add_ps(boxExtents, reach))) return SPATIAL_OUTSIDE;
+
+	// Box axes, lane j for axis j: the offset and the world box's reach projected onto each.
+	__m128 projectedOffset = _mm_setzero_ps();
+	__m128 projectedReach = _mm_setzero_ps();
+	for (int i = 0; i < 3; i++) {
+		projectedOffset = _mm_add_ps(projectedOffset, _mm_mul_ps(_mm_set1_ps(offsets[i]), rows[i]));
+		projectedReach = _mm_add_ps(projectedReach, _mm_mul_ps(_mm_set1_ps(boxReach[i]), absoluteRows[i]));
+	}
+	projectedOffset = Absolute(projectedOffset);
+	if (AnyGreater3(projectedOffset, _mm_add_ps(projectedReach, extents))) return SPATIAL_OUTSIDE;
+
+	// Cross products of world axis i with box axis j, lane j, following the usual separating axis terms.
+	for (int i = 0; i < 3; i++) {
+		int i1 = (i + 1) % 3;
+		int i2 = (i + 2) % 3;
+		__m128 distance = Absolute(_mm_sub_ps(
+			_mm_mul_ps(_mm_set1_ps(offsets[i2]), rows[i1]),
+			_mm_mul_ps(_mm_set1_ps(offsets[i1]), rows[i2])));
+		__m128 reachWorld = _mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(boxReach[i1]), paddedRows[i2]),
+			_mm_mul_ps(_mm_set1_ps(boxReach[i2]), paddedRows[i1]));
+		__m128 reachOriented = _mm_add_ps(
+			_mm_mul_ps(extentsNext, RotateLast(paddedRows[i])),
+			_mm_mul_ps(extentsLast, RotateNext(paddedRows[i])));
+		if (AnyGreater3(distance, _mm_add_ps(reachWorld, reachOriented))) return SPATIAL_OUTSIDE;
+	}
+
+	// Inside when the world box's projection onto each box axis stays within the extent along it.
+	return AnyGreater3(_mm_add_ps(projectedOffset, projectedReach), extents) ? SPATIAL_INTERSECTING : SPATIAL_INSIDE;
+};
+
+/// Drops the items that only intersect the oriented box when contained items are wanted.
+bool OrientedBoxQuery::Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) {
+	if (contained && overlap != SPATIAL_INSIDE) return true;
+	return ShapeHits::Visit(itemId, bounds, overlap);
+};
+
+BoxBatch::BoxBatch() {
+
+};
+
+void BoxBatch::Add(const AABB& box, bool contained) {
+	bounds = boxes.empty() ? box : Union(bounds, box);
+	boxes.push_back(box);
+	this->contained.push_back(contained);
+	results.push_back(std::vector<int>());
+};
+
+AABB BoxBatch::Bounds() const {
+	return bounds;
+};
+
+SpatialOverlap BoxBatch::Classify(const AABB& bounds) const {
+	bool anyIntersecting = false;
+	bool allInside = true;
+	for (size_t i = 0; i < boxes.size(); i++) {
+		if (!intersects(boxes[i], bounds)) {
+			allInside = false;
+			continue;
+		}
+		anyIntersecting = true;
+		allInside = allInside && contains(boxes[i], bounds);
+	}
+	if (!anyIntersecting) return SPATIAL_OUTSIDE;
+	return allInside ? SPATIAL_INSIDE : SPATIAL_INTERSECTING;
+};
+
+/// Items below a node inside every box belong to all of them; the others are tested box by box.
+bool BoxBatch::Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) {
+	for (size_t i = 0; i < boxes.size(); i++) {
+		if (overlap != SPATIAL_INSIDE) {
+			if (contained[i] ? !contains(boxes[i], bounds) : !intersects(boxes[i], bounds)) continue;
+		}
+		results[i].push_back(itemId);
+	}
+	return true;
+};
+
+/// Returns the ids found for the box added at position member.
+const std::vector<int>& BoxBatch::Results(int member) const {
+	return results[member];
+};
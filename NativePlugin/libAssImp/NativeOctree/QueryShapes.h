@@ -0,0 +1,222 @@
+#pragma once
+#include "libAssImp\VectorTypes.h"
+#include "AABB.h"
+#include "SpatialVisitor.h"
+#include <vector>
+
+/// Collects the closest items offered to a NearestVisitor, up to maxCount of them, in a bounded max-heap. Once
+/// the heap is full its farthest item sets MaxDistance, so the traversal only goes on looking for closer items.
+class NearestHits : public NearestVisitor {
+public:
+	NearestHits(float maxDistance, int maxCount);
+
+	float MaxDistance() const override;
+	void Visit(int itemId, const AABB& bounds, float distance) override;
+
+	/// Writes the ids, and the distances unless distanceArray is null, of the collected items closest first,
+	/// and returns their count.
+	int Write(int* idArray, float* distanceArray);
+
+private:
+	struct Hit {
+		float distance;
+		int itemId;
+	};
+
+	/// Heap order that keeps the farthest collected item on top. Ties go by id, so results don't depend on
+	/// the order a backend offers equidistant items in.
+	static bool Closer(const Hit& a, const Hit& b);
+
+	std::vector<Hit> heap;
+	float maxDistance;
+	int maxCount;
+};
+
+/// Ray from origin along direction, hitting the items whose bounds it passes through within maxDistance. The
+/// distance to an item is where the ray enters its bounds, or 0 if the ray starts inside them, measured in
+/// world units since the direction is normalized. A zero direction hits nothing.
+class RayQuery : public NearestHits {
+public:
+	RayQuery(Vector3 origin, Vector3 direction, float maxDistance, int maxHits);
+
+	AABB Bounds() const override;
+
+	/// Slab test of the ray against bounds, all three axes at once.
+	float Distance(const AABB& bounds) const override;
+
+private:
+	__m128 origin;
+	/// Reciprocal of the normalized direction, clamped to finite values so axis-parallel rays need no special
+	/// case.
+	__m128 inverseDirection;
+	float length;
+	AABB bounds;
+};
+
+/// Point whose nearest items are wanted, by the squared distance from the point to the closest point of each
+/// item's bounds. Items the point lies inside are at distance 0. Only items within maxDistance count, which
+/// may be infinite.
+class PointQuery : public NearestHits {
+public:
+	PointQuery(Vector3 point, float maxDistance, int maxCount);
+
+	AABB Bounds() const override;
+
+	/// Squared distance from the point to bounds, all three axes at once.
+	float Distance(const AABB& bounds) const override;
+
+private:
+	__m128 point;
+	AABB bounds;
+};
+
+/// Collects the ids of the items a SpatialVisitor's shape overlaps into a caller's array, and ends the
+/// traversal once the array is full. If overlapArray isn't null, the SpatialOverlap of each item goes to the
+/// same position in it.
+class ShapeHits : public SpatialVisitor {
+public:
+	ShapeHits(int* returnArray, int returnArrayMaxSize, int* overlapArray = nullptr);
+
+	bool Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) override;
+
+	/// Returns the number of ids written.
+	int Count() const;
+
+private:
+	int* returnArray;
+	int* overlapArray;
+	int returnArrayMaxSize;
+	int curNumResults;
+};
+
+/// Sphere overlapping the items whose bounds come within radius of its center.
+class SphereQuery : public ShapeHits {
+public:
+	SphereQuery(Vector3 center, float radius, int* returnArray, int returnArrayMaxSize);
+
+	AABB Bounds() const override;
+
+	/// Intersecting if the box comes within radius of the center, and inside if its farthest corner does.
+	SpatialOverlap Classify(const AABB& bounds) const override;
+
+private:
+	__m128 center;
+	float radiusSquared;
+	AABB bounds;
+};
+
+/// Capsule swept by a sphere of radius moving from start to end, overlapping the items whose bounds come
+/// within radius of the segment.
+class CapsuleQuery : public ShapeHits {
+public:
+	CapsuleQuery(Vector3 start, Vector3 end, float radius, int* returnArray, int returnArrayMaxSize);
+
+	AABB Bounds() const override;
+
+	/// Culls with a slab test of the segment against the box grown by radius, then measures the exact distance
+	/// from the segment to the box. Inside if all eight corners lie within the capsule.
+	SpatialOverlap Classify(const AABB& bounds) const override;
+
+private:
+	/// Returns the squared distance from the segment to bounds.
+	float DistanceSquared(const AABB& bounds) const;
+
+	__m128 start;
+	__m128 step;
+	/// Reciprocal of step, clamped to finite values like the ray's.
+	__m128 inverseStep;
+	float radius;
+	AABB bounds;
+};
+
+/// Planes a FrustumQuery is bounded by.
+static const int kFrustumPlanes = 6;
+
+/// Convex volume bounded by six planes, such as a camera's view frustum. Each plane is given as its normal
+/// and distance, and the inside is where dot(normal, point) + distance >= 0, as with Unity's Plane. Boxes are
+/// classified plane by plane, which can let a box just past an edge of the volume through as intersecting.
+class FrustumQuery : public ShapeHits {
+public:
+	/// Reads kFrustumPlanes planes of four floats each from planes.
+	FrustumQuery(const float* planes, int* returnArray, int returnArrayMaxSize, int* overlapArray);
+
+	/// An unbounded box: six planes don't have to enclose a finite volume, such as a frustum without a far
+	/// plane, so the backends without a hierarchy test every item.
+	AABB Bounds() const override;
+
+	/// Tests the box corner farthest along and farthest against each plane's normal, for four planes at once.
+	SpatialOverlap Classify(const AABB& bounds) const override;
+
+private:
+	/// Plane components for two groups of four planes. The two spare planes of the second group contain
+	/// everything.
+	__m128 normalX[2];
+	__m128 normalY[2];
+	__m128 normalZ[2];
+	__m128 distance[2];
+	/// All ones in the lanes of planes whose normal component is negative.
+	__m128 negativeX[2];
+	__m128 negativeY[2];
+	__m128 negativeZ[2];
+};
+
+/// Box of the given center and half extents rotated by a unit quaternion, given as x, y, z and w like Unity's
+/// Quaternion. Finds the items intersecting it, or with contained set, the items lying inside it.
+class OrientedBoxQuery : public ShapeHits {
+public:
+	OrientedBoxQuery(Vector3 center, Vector3 extents, const float* rotation, bool contained, int* returnArray, int returnArrayMaxSize);
+
+	AABB Bounds() const override;
+
+	/// Separating axis test of the oriented box against bounds: the three world axes, the three box axes and
+	/// their nine cross products, each group of three tested at once. Inside if bounds projects within the
+	/// oriented box on each of its axes.
+	SpatialOverlap Classify(const AABB& bounds) const override;
+
+	/// Drops the items that only intersect the oriented box when contained items are wanted.
+	bool Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) override;
+
+private:
+	__m128 center;
+	/// Half extents of the oriented box, and the same rotated by one and by two lanes.
+	__m128 extents;
+	__m128 extentsNext;
+	__m128 extentsLast;
+	/// Row i holds component i of the three box axes, so lane j of row i is the cosine between world axis i
+	/// and box axis j.
+	__m128 rows[3];
+	__m128 absoluteRows[3];
+	/// absoluteRows padded against the cross products of nearly parallel axes vanishing in rounding.
+	__m128 paddedRows[3];
+	/// Half extents of the oriented box's bounds along the world axes.
+	__m128 reach;
+	AABB bounds;
+	bool contained;
+};
+
+/// Several box queries answered in a single traversal, for boxes close enough together that their own
+/// traversals would mostly visit the same nodes. A node is opened if it overlaps any of the boxes, and each
+/// item reaching Visit is tested against every box.
+class BoxBatch : public SpatialVisitor {
+public:
+	BoxBatch();
+
+	/// Adds a box looking for the items it intersects, or with contained set, the items lying inside it.
+	void Add(const AABB& box, bool contained);
+
+	AABB Bounds() const override;
+
+	/// Outside if no box intersects bounds, and inside if every box contains it.
+	SpatialOverlap Classify(const AABB& bounds) const override;
+
+	bool Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) override;
+
+	/// Returns the ids found for the box added at position member.
+	const std::vector<int>& Results(int member) const;
+
+private:
+	std::vector<AABB> boxes;
+	std::vector<char> contained;
+	std::vector<std::vector<int> > results;
+	AABB bounds;
+};
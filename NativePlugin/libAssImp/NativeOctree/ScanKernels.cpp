@@ -0,0 +1,118 @@
+#include "ScanKernels.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void Cpuid(unsigned int leaf, unsigned int subleaf, unsigned int info[4]) {
+#ifdef _MSC_VER
+	__cpuidex((int*)info, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+/// Returns the register state the OS saves on context switches, which is only valid if the OSXSAVE bit is set.
+static unsigned long long ReadXcr0() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax;
+	unsigned int edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static const ScanKernels* KernelsFor(ScanKernelLevel level) {
+	switch (level) {
+	case SCAN_KERNEL_AVX512:
+		return &kAVX512ScanKernels;
+	case SCAN_KERNEL_AVX2:
+		return &kAVX2ScanKernels;
+	case SCAN_KERNEL_SSE2:
+		return &kSSE2ScanKernels;
+	default:
+		return &kScalarScanKernels;
+	}
+}
+
+/// Returns the widest kernel level the CPU implements, the OS saves the registers of, and this build includes.
+static ScanKernelLevel DetectScanKernelLevel() {
+	unsigned int info[4];
+	Cpuid(0, 0, info);
+	unsigned int maxLeaf = info[0];
+	Cpuid(1, 0, info);
+	bool hasSSE2 = (info[3] & (1u << 26)) != 0;
+	bool hasOSXSave = (info[2] & (1u << 27)) != 0;
+	bool hasAVX = (info[2] & (1u << 28)) != 0;
+	unsigned int extendedFeatures = 0;
+	if (maxLeaf >= 7) {
+		Cpuid(7, 0, info);
+		extendedFeatures = info[1];
+	}
+	unsigned long long xcr0 = hasOSXSave ? ReadXcr0() : 0;
+	// AVX needs the XMM and YMM state saved, and AVX-512 additionally the opmask and both halves of the ZMM state.
+	bool savesAVX = (xcr0 & 0x6) == 0x6;
+	bool savesAVX512 = (xcr0 & 0xE6) == 0xE6;
+
+	if (savesAVX512 && (extendedFeatures & (1u << 16)) != 0 && kAVX512ScanKernels.intersectedBy != nullptr) {
+		return SCAN_KERNEL_AVX512;
+	}
+	if (hasAVX && savesAVX && (extendedFeatures & (1u << 5)) != 0 && kAVX2ScanKernels.intersectedBy != nullptr) {
+		return SCAN_KERNEL_AVX2;
+	}
+	return hasSSE2 ? SCAN_KERNEL_SSE2 : SCAN_KERNEL_SCALAR;
+}
+
+/// Detected once when the library loads. The kernel tables are constant initialized, so they are ready
+/// before this runs.
+static const ScanKernelLevel supportedLevel = DetectScanKernelLevel();
+static ScanKernelLevel activeLevel = supportedLevel;
+static const ScanKernels* activeKernels = KernelsFor(supportedLevel);
+
+/// Returns the kernel level used by the scans.
+ScanKernelLevel GetScanKernelLevel() {
+	return activeLevel;
+}
+
+/// Switches the scans to level, or to the widest supported level below it, and returns the level now in use.
+ScanKernelLevel SetScanKernelLevel(ScanKernelLevel level) {
+	int target = level < supportedLevel ? level : supportedLevel;
+	while (target > SCAN_KERNEL_SCALAR && KernelsFor((ScanKernelLevel)target)->intersectedBy == nullptr) {
+		target--;
+	}
+	activeLevel = (ScanKernelLevel)target;
+	activeKernels = KernelsFor(activeLevel);
+	return activeLevel;
+}
+
+/// Writes the ids of the boxes intersecting testBounds into returnArray, stopping at returnArrayMaxSize.
+int ScanIntersectedBy(const AABBArray& boxes, const AABB& testBounds, int* returnArray, int returnArrayMaxSize) {
+	return ScanIntersectedBy(boxes, 0, boxes.Size(), testBounds, returnArray, returnArrayMaxSize);
+}
+
+/// Like ScanIntersectedBy, for the boxes from position begin up to end only.
+int ScanIntersectedBy(const AABBArray& boxes, size_t begin, size_t end, const AABB& testBounds, int* returnArray, int returnArrayMaxSize) {
+	float testMin[4];
+	float testMax[4];
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+	return activeKernels->intersectedBy(boxes, begin, end, testMin, testMax, returnArray, returnArrayMaxSize);
+}
+
+/// Writes the ids of the boxes fully contained by testBounds into returnArray, stopping at returnArrayMaxSize.
+int ScanContainedBy(const AABBArray& boxes, const AABB& testBounds, int* returnArray, int returnArrayMaxSize) {
+	return ScanContainedBy(boxes, 0, boxes.Size(), testBounds, returnArray, returnArrayMaxSize);
+}
+
+/// Like ScanContainedBy, for the boxes from position begin up to end only.
+int ScanContainedBy(const AABBArray& boxes, size_t begin, size_t end, const AABB& testBounds, int* returnArray, int returnArrayMaxSize) {
+	float testMin[4];
+	float testMax[4];
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+	return activeKernels->containedBy(boxes, begin, end, testMin, testMax, returnArray, returnArrayMaxSize);
+}
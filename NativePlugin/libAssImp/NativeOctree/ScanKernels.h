@@ -0,0 +1,101 @@
+#pragma once
+#include "AABBArray.h"
+#include <cstddef>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// Instruction set variants of the AABBArray scan kernels, from narrowest to widest.
+enum ScanKernelLevel {
+	SCAN_KERNEL_SCALAR = 0,
+	SCAN_KERNEL_SSE2 = 1,
+	SCAN_KERNEL_AVX2 = 2,
+	SCAN_KERNEL_AVX512 = 3,
+};
+
+/// Writes the ids of the boxes from position begin up to end passing the kernel's test against the box from
+/// testMin to testMax into returnArray, stopping at returnArrayMaxSize.
+typedef int(*ScanFunction)(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize);
+
+/// The scan kernels of one instruction set variant. Each variant is compiled in its own translation unit
+/// with the matching code generation flags.
+struct ScanKernels {
+	ScanFunction intersectedBy;
+	ScanFunction containedBy;
+};
+
+/// Kernel tables of each variant. The entries of a variant the compiler can't build are null.
+extern const ScanKernels kScalarScanKernels;
+extern const ScanKernels kSSE2ScanKernels;
+extern const ScanKernels kAVX2ScanKernels;
+extern const ScanKernels kAVX512ScanKernels;
+
+/// Returns the kernel level used by the scans. It is the widest level the CPU, the OS and this build support,
+/// detected once when the library loads.
+ScanKernelLevel GetScanKernelLevel();
+
+/// Switches the scans to level, or to the widest supported level below it, and returns the level now in use.
+/// Meant for comparing kernels; not safe to call while scans run on other threads.
+ScanKernelLevel SetScanKernelLevel(ScanKernelLevel level);
+
+/// Writes the ids of the boxes intersecting testBounds into returnArray, stopping at returnArrayMaxSize.
+int ScanIntersectedBy(const AABBArray& boxes, const AABB& testBounds, int* returnArray, int returnArrayMaxSize);
+
+/// Writes the ids of the boxes fully contained by testBounds into returnArray, stopping at returnArrayMaxSize.
+int ScanContainedBy(const AABBArray& boxes, const AABB& testBounds, int* returnArray, int returnArrayMaxSize);
+
+/// Like ScanIntersectedBy, for the boxes from position begin up to end only.
+int ScanIntersectedBy(const AABBArray& boxes, size_t begin, size_t end, const AABB& testBounds, int* returnArray, int returnArrayMaxSize);
+
+/// Like ScanContainedBy, for the boxes from position begin up to end only.
+int ScanContainedBy(const AABBArray& boxes, size_t begin, size_t end, const AABB& testBounds, int* returnArray, int returnArrayMaxSize);
+
+/// Returns the index of the lowest set bit of a non-zero mask.
+static inline int LowestBit(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+/// Appends ids[k] to returnArray for every bit k set in hits. Returns false once returnArray is full.
+static inline bool EmitHits(unsigned int hits, const int* ids, int* returnArray, int returnArrayMaxSize, int& curNumResults) {
+	while (hits != 0) {
+		returnArray[curNumResults] = ids[LowestBit(hits)];
+		curNumResults++;
+		if (curNumResults >= returnArrayMaxSize) return false;
+		hits &= hits - 1;
+	}
+	return true;
+}
+
+/// Tests the boxes from position i up to end one at a time, for the scalar kernel and the tails of the vector ones.
+static inline int ScanIntersectedByFrom(const AABBArray& boxes, size_t i, size_t end, const float* testMin, const float* testMax,
+	int* returnArray, int returnArrayMaxSize, int curNumResults) {
+	for (; i < end; i++) {
+		if (testMax[0] < boxes.minX[i] || testMin[0] > boxes.maxX[i] ||
+			testMax[1] < boxes.minY[i] || testMin[1] > boxes.maxY[i] ||
+			testMax[2] < boxes.minZ[i] || testMin[2] > boxes.maxZ[i]) continue;
+		returnArray[curNumResults] = boxes.ids[i];
+		curNumResults++;
+		if (curNumResults >= returnArrayMaxSize) return curNumResults;
+	}
+	return curNumResults;
+}
+
+/// Tests the boxes from position i up to end one at a time, for the scalar kernel and the tails of the vector ones.
+static inline int ScanContainedByFrom(const AABBArray& boxes, size_t i, size_t end, const float* testMin, const float* testMax,
+	int* returnArray, int returnArrayMaxSize, int curNumResults) {
+	for (; i < end; i++) {
+		if (testMin[0] > boxes.minX[i] || testMax[0] < boxes.maxX[i] ||
+			testMin[1] > boxes.minY[i] || testMax[1] < boxes.maxY[i] ||
+			testMin[2] > boxes.minZ[i] || testMax[2] < boxes.maxZ[i]) continue;
+		returnArray[curNumResults] = boxes.ids[i];
+		curNumResults++;
+		if (curNumResults >= returnArrayMaxSize) return curNumResults;
+	}
+	return curNumResults;
+}
@@ -0,0 +1,59 @@
+#include "ScanKernels.h"
+
+// MSVC accepts AVX intrinsics in any translation unit; the project compiles this one with /arch:AVX2 so the
+// surrounding code is VEX encoded too. Other compilers need -mavx2.
+#if defined(__AVX2__) || defined(_MSC_VER)
+#include <immintrin.h> //AVX2
+
+/// Tests 8 boxes per iteration, with the same lane tests as the SSE2 kernel.
+static int IntersectedByAVX2(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize) {
+	int curNumResults = 0;
+	size_t i = begin;
+	__m256 testMinX = _mm256_set1_ps(testMin[0]);
+	__m256 testMinY = _mm256_set1_ps(testMin[1]);
+	__m256 testMinZ = _mm256_set1_ps(testMin[2]);
+	__m256 testMaxX = _mm256_set1_ps(testMax[0]);
+	__m256 testMaxY = _mm256_set1_ps(testMax[1]);
+	__m256 testMaxZ = _mm256_set1_ps(testMax[2]);
+	for (; i + 8 <= end; i += 8) {
+		__m256 miss = _mm256_or_ps(
+			_mm256_cmp_ps(testMaxX, _mm256_loadu_ps(&boxes.minX[i]), _CMP_LT_OQ),
+			_mm256_cmp_ps(testMinX, _mm256_loadu_ps(&boxes.maxX[i]), _CMP_GT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(testMaxY, _mm256_loadu_ps(&boxes.minY[i]), _CMP_LT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(testMinY, _mm256_loadu_ps(&boxes.maxY[i]), _CMP_GT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(testMaxZ, _mm256_loadu_ps(&boxes.minZ[i]), _CMP_LT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(testMinZ, _mm256_loadu_ps(&boxes.maxZ[i]), _CMP_GT_OQ));
+		unsigned int hits = ~(unsigned int)_mm256_movemask_ps(miss) & 0xFF;
+		if (!EmitHits(hits, &boxes.ids[i], returnArray, returnArrayMaxSize, curNumResults)) return curNumResults;
+	}
+	return ScanIntersectedByFrom(boxes, i, end, testMin, testMax, returnArray, returnArrayMaxSize, curNumResults);
+}
+
+/// Tests 8 boxes per iteration, with the same lane tests as the SSE2 kernel.
+static int ContainedByAVX2(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize) {
+	int curNumResults = 0;
+	size_t i = begin;
+	__m256 testMinX = _mm256_set1_ps(testMin[0]);
+	__m256 testMinY = _mm256_set1_ps(testMin[1]);
+	__m256 testMinZ = _mm256_set1_ps(testMin[2]);
+	__m256 testMaxX = _mm256_set1_ps(testMax[0]);
+	__m256 testMaxY = _mm256_set1_ps(testMax[1]);
+	__m256 testMaxZ = _mm256_set1_ps(testMax[2]);
+	for (; i + 8 <= end; i += 8) {
+		__m256 miss = _mm256_or_ps(
+			_mm256_cmp_ps(testMinX, _mm256_loadu_ps(&boxes.minX[i]), _CMP_GT_OQ),
+			_mm256_cmp_ps(testMaxX, _mm256_loadu_ps(&boxes.maxX[i]), _CMP_LT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(testMinY, _mm256_loadu_ps(&boxes.minY[i]), _CMP_GT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(testMaxY, _mm256_loadu_ps(&boxes.maxY[i]), _CMP_LT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(testMinZ, _mm256_loadu_ps(&boxes.minZ[i]), _CMP_GT_OQ));
+		miss = _mm256_or_ps(miss, _mm256_cmp_ps(testMaxZ, _mm256_loadu_ps(&boxes.maxZ[i]), _CMP_LT_OQ));
+		unsigned int hits = ~(unsigned int)_mm256_movemask_ps(miss) & 0xFF;
+		if (!EmitHits(hits, &boxes.ids[i], returnArray, returnArrayMaxSize, curNumResults)) return curNumResults;
+	}
+	return ScanContainedByFrom(boxes, i, end, testMin, testMax, returnArray, returnArrayMaxSize, curNumResults);
+}
+
+const ScanKernels kAVX2ScanKernels = { IntersectedByAVX2, ContainedByAVX2 };
+#else
+const ScanKernels kAVX2ScanKernels = { nullptr, nullptr };
+#endif
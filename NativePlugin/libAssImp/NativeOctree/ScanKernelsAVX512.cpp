@@ -0,0 +1,57 @@
+#include "ScanKernels.h"
+
+// Visual Studio 2017 15.3 is the first MSVC with AVX-512 intrinsics. Other compilers need -mavx512f.
+#if defined(__AVX512F__) || (defined(_MSC_VER) && _MSC_VER >= 1911)
+#include <immintrin.h> //AVX-512
+
+/// Tests 16 boxes per iteration, with the same lane tests as the SSE2 kernel. The compares write mask
+/// registers directly, so there is no movemask step.
+static int IntersectedByAVX512(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize) {
+	int curNumResults = 0;
+	size_t i = begin;
+	__m512 testMinX = _mm512_set1_ps(testMin[0]);
+	__m512 testMinY = _mm512_set1_ps(testMin[1]);
+	__m512 testMinZ = _mm512_set1_ps(testMin[2]);
+	__m512 testMaxX = _mm512_set1_ps(testMax[0]);
+	__m512 testMaxY = _mm512_set1_ps(testMax[1]);
+	__m512 testMaxZ = _mm512_set1_ps(testMax[2]);
+	for (; i + 16 <= end; i += 16) {
+		__mmask16 miss = _mm512_cmp_ps_mask(testMaxX, _mm512_loadu_ps(&boxes.minX[i]), _CMP_LT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMinX, _mm512_loadu_ps(&boxes.maxX[i]), _CMP_GT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMaxY, _mm512_loadu_ps(&boxes.minY[i]), _CMP_LT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMinY, _mm512_loadu_ps(&boxes.maxY[i]), _CMP_GT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMaxZ, _mm512_loadu_ps(&boxes.minZ[i]), _CMP_LT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMinZ, _mm512_loadu_ps(&boxes.maxZ[i]), _CMP_GT_OQ);
+		unsigned int hits = ~(unsigned int)miss & 0xFFFF;
+		if (!EmitHits(hits, &boxes.ids[i], returnArray, returnArrayMaxSize, curNumResults)) return curNumResults;
+	}
+	return ScanIntersectedByFrom(boxes, i, end, testMin, testMax, returnArray, returnArrayMaxSize, curNumResults);
+}
+
+/// Tests 16 boxes per iteration, with the same lane tests as the SSE2 kernel.
+static int ContainedByAVX512(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize) {
+	int curNumResults = 0;
+	size_t i = begin;
+	__m512 testMinX = _mm512_set1_ps(testMin[0]);
+	__m512 testMinY = _mm512_set1_ps(testMin[1]);
+	__m512 testMinZ = _mm512_set1_ps(testMin[2]);
+	__m512 testMaxX = _mm512_set1_ps(testMax[0]);
+	__m512 testMaxY = _mm512_set1_ps(testMax[1]);
+	__m512 testMaxZ = _mm512_set1_ps(testMax[2]);
+	for (; i + 16 <= end; i += 16) {
+		__mmask16 miss = _mm512_cmp_ps_mask(testMinX, _mm512_loadu_ps(&boxes.minX[i]), _CMP_GT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMaxX, _mm512_loadu_ps(&boxes.maxX[i]), _CMP_LT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMinY, _mm512_loadu_ps(&boxes.minY[i]), _CMP_GT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMaxY, _mm512_loadu_ps(&boxes.maxY[i]), _CMP_LT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMinZ, _mm512_loadu_ps(&boxes.minZ[i]), _CMP_GT_OQ);
+		miss |= _mm512_cmp_ps_mask(testMaxZ, _mm512_loadu_ps(&boxes.maxZ[i]), _CMP_LT_OQ);
+		unsigned int hits = ~(unsigned int)miss & 0xFFFF;
+		if (!EmitHits(hits, &boxes.ids[i], returnArray, returnArrayMaxSize, curNumResults)) return curNumResults;
+	}
+	return ScanContainedByFrom(boxes, i, end, testMin, testMax, returnArray, returnArrayMaxSize, curNumResults);
+}
+
+const ScanKernels kAVX512ScanKernels = { IntersectedByAVX512, ContainedByAVX512 };
+#else
+const ScanKernels kAVX512ScanKernels = { nullptr, nullptr };
+#endif
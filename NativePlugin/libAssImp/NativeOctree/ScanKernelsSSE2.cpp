@@ -0,0 +1,55 @@
+#include "ScanKernels.h"
+#include <xmmintrin.h> //SSE
+#include <emmintrin.h> //SSE2
+
+/// Tests 4 boxes per iteration. Like intersects(), a lane misses if the test box ends before the item starts or
+/// starts after it ends on any axis, and the hits are the lanes left over.
+static int IntersectedBySSE2(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize) {
+	int curNumResults = 0;
+	size_t i = begin;
+	__m128 testMinX = _mm_set1_ps(testMin[0]);
+	__m128 testMinY = _mm_set1_ps(testMin[1]);
+	__m128 testMinZ = _mm_set1_ps(testMin[2]);
+	__m128 testMaxX = _mm_set1_ps(testMax[0]);
+	__m128 testMaxY = _mm_set1_ps(testMax[1]);
+	__m128 testMaxZ = _mm_set1_ps(testMax[2]);
+	for (; i + 4 <= end; i += 4) {
+		__m128 miss = _mm_or_ps(
+			_mm_cmplt_ps(testMaxX, _mm_loadu_ps(&boxes.minX[i])),
+			_mm_cmpgt_ps(testMinX, _mm_loadu_ps(&boxes.maxX[i])));
+		miss = _mm_or_ps(miss, _mm_cmplt_ps(testMaxY, _mm_loadu_ps(&boxes.minY[i])));
+		miss = _mm_or_ps(miss, _mm_cmpgt_ps(testMinY, _mm_loadu_ps(&boxes.maxY[i])));
+		miss = _mm_or_ps(miss, _mm_cmplt_ps(testMaxZ, _mm_loadu_ps(&boxes.minZ[i])));
+		miss = _mm_or_ps(miss, _mm_cmpgt_ps(testMinZ, _mm_loadu_ps(&boxes.maxZ[i])));
+		unsigned int hits = ~(unsigned int)_mm_movemask_ps(miss) & 0xF;
+		if (!EmitHits(hits, &boxes.ids[i], returnArray, returnArrayMaxSize, curNumResults)) return curNumResults;
+	}
+	return ScanIntersectedByFrom(boxes, i, end, testMin, testMax, returnArray, returnArrayMaxSize, curNumResults);
+}
+
+/// Tests 4 boxes per iteration. Like contains(), a lane misses if the item starts before the test box or ends
+/// after it on any axis.
+static int ContainedBySSE2(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize) {
+	int curNumResults = 0;
+	size_t i = begin;
+	__m128 testMinX = _mm_set1_ps(testMin[0]);
+	__m128 testMinY = _mm_set1_ps(testMin[1]);
+	__m128 testMinZ = _mm_set1_ps(testMin[2]);
+	__m128 testMaxX = _mm_set1_ps(testMax[0]);
+	__m128 testMaxY = _mm_set1_ps(testMax[1]);
+	__m128 testMaxZ = _mm_set1_ps(testMax[2]);
+	for (; i + 4 <= end; i += 4) {
+		__m128 miss = _mm_or_ps(
+			_mm_cmpgt_ps(testMinX, _mm_loadu_ps(&boxes.minX[i])),
+			_mm_cmplt_ps(testMaxX, _mm_loadu_ps(&boxes.maxX[i])));
+		miss = _mm_or_ps(miss, _mm_cmpgt_ps(testMinY, _mm_loadu_ps(&boxes.minY[i])));
+		miss = _mm_or_ps(miss, _mm_cmplt_ps(testMaxY, _mm_loadu_ps(&boxes.maxY[i])));
+		miss = _mm_or_ps(miss, _mm_cmpgt_ps(testMinZ, _mm_loadu_ps(&boxes.minZ[i])));
+		miss = _mm_or_ps(miss, _mm_cmplt_ps(testMaxZ, _mm_loadu_ps(&boxes.maxZ[i])));
+		unsigned int hits = ~(unsigned int)_mm_movemask_ps(miss) & 0xF;
+		if (!EmitHits(hits, &boxes.ids[i], returnArray, returnArrayMaxSize, curNumResults)) return curNumResults;
+	}
+	return ScanContainedByFrom(boxes, i, end, testMin, testMax, returnArray, returnArrayMaxSize, curNumResults);
+}
+
+const ScanKernels kSSE2ScanKernels = { IntersectedBySSE2, ContainedBySSE2 };
@@ -0,0 +1,11 @@
+#include "ScanKernels.h"
+
+static int IntersectedByScalar(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize) {
+	return ScanIntersectedByFrom(boxes, begin, end, testMin, testMax, returnArray, returnArrayMaxSize, 0);
+}
+
+static int ContainedByScalar(const AABBArray& boxes, size_t begin, size_t end, const float* testMin, const float* testMax, int* returnArray, int returnArrayMaxSize) {
+	return ScanContainedByFrom(boxes, begin, end, testMin, testMax, returnArray, returnArrayMaxSize, 0);
+}
+
+const ScanKernels kScalarScanKernels = { IntersectedByScalar, ContainedByScalar };
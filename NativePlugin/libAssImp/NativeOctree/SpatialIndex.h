@@ -0,0 +1,89 @@
+#pragma once
+#include "AABB.h"
+#include "SpatialVisitor.h"
+
+/// Acceleration structures a SpatialPartitioner can be backed by.
+enum SpatialPartitionerBackend {
+	SPATIAL_BACKEND_BVH = 0,
+	SPATIAL_BACKEND_OCTREE = 1,
+	SPATIAL_BACKEND_SWEEP_AND_PRUNE = 2,
+	SPATIAL_BACKEND_HASHED_GRID = 3,
+	SPATIAL_BACKEND_LINEAR = 4,
+	/// Picks one of the linear scan, BVH and hashed grid from the observed workload, and switches as it changes.
+	SPATIAL_BACKEND_AUTO = 5,
+	/// Linear scan over 16-bit bounds quantized against the world volume. Never picked by SPATIAL_BACKEND_AUTO.
+	SPATIAL_BACKEND_QUANTIZED = 6,
+};
+
+/// Interface implemented by the acceleration structures behind a SpatialPartitioner. Items are addressed by
+/// the proxy returned from Insert, which stays valid until the item is removed.
+class SpatialIndex {
+public:
+	virtual ~SpatialIndex() {};
+
+	/// Inserts an item with the given bounds and returns its proxy.
+	virtual int Insert(int itemId, const AABB& bounds) = 0;
+
+	/// Inserts count items at once and writes their proxies to proxies. Item ids are read from the id lane of
+	/// the bounds. Backends that can build a better structure from the whole set override this.
+	virtual void InsertMany(const AABB* bounds, int count, int* proxies) {
+		for (int i = 0; i < count; i++) {
+			proxies[i] = Insert(IdFromAABB(bounds[i]), bounds[i]);
+		}
+	};
+
+	/// Moves the item behind proxy to new bounds.
+	virtual void Update(int proxy, const AABB& bounds) = 0;
+
+	/// Removes the item behind proxy.
+	virtual void Remove(int proxy) = 0;
+
+	/// Moves count items at once, the item behind proxies[i] to bounds[i]. Backends that can restructure once
+	/// for the whole batch override this.
+	virtual void UpdateMany(const int* proxies, const AABB* bounds, int count) {
+		for (int i = 0; i < count; i++) {
+			Update(proxies[i], bounds[i]);
+		}
+	};
+
+	/// Removes the items behind count distinct proxies at once.
+	virtual void RemoveMany(const int* proxies, int count) {
+		for (int i = 0; i < count; i++) {
+			Remove(proxies[i]);
+		}
+	};
+
+	/// Removes all items.
+	virtual void Clear() = 0;
+
+	/// Brings up to date whatever the queries maintain lazily, so that queries write nothing until the next
+	/// change and can run on several threads at once. Backends whose queries have no such state needn't override
+	/// this.
+	virtual void Prepare() const {};
+
+	/// Writes the ids of items fully contained by testBounds into returnArray, stopping at returnArrayMaxSize.
+	virtual int ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const = 0;
+
+	/// Writes the ids of items intersecting testBounds into returnArray, stopping at returnArrayMaxSize.
+	virtual int IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const = 0;
+
+	/// Returns the number of items fully contained by testBounds, or intersecting it if contained isn't set,
+	/// counting no further than maxCount, which must be positive. Backends with a cheaper path than a
+	/// traversal override this.
+	virtual int Count(const AABB& testBounds, bool contained, int maxCount) const {
+		BoxCounter counter(testBounds, contained, maxCount);
+		Traverse(counter);
+		return counter.Count();
+	};
+
+	/// Hands the items overlapping the visitor's shape to the visitor, skipping whatever the shape classifies as
+	/// outside, until the visitor asks to stop.
+	virtual void Traverse(SpatialVisitor& visitor) const = 0;
+
+	/// Hands the items within the visitor's MaxDistance to the visitor. Hierarchical backends override this to
+	/// visit nodes closest first, so the visitor's MaxDistance shrinks early and prunes the rest of the index.
+	virtual void TraverseNearest(NearestVisitor& visitor) const {
+		NearestFilter filter(visitor);
+		Traverse(filter);
+	};
+};
@@ -5,18 +5,75 @@
 #include "libAssImp\VectorTypes.h"
 
 extern "C" {
-	/// Allocates an SpatialPartitioner and returns a handle.
+	/// Allocates an SpatialPartitioner and returns a handle, or -1 if a million partitioners are already allocated.
 	BLOCKSEXPORT int AllocSpatialPartitioner(Vector3 center, Vector3 size);
 
+	/// Allocates an SpatialPartitioner backed by a loose octree over the given bounds and returns a handle.
+	/// maxDepth is clamped to [0, 10], and looseness, the factor cells' bounds are scaled by, to at least 1.
+	BLOCKSEXPORT int AllocSpatialPartitionerOctree(Vector3 center, Vector3 size, int maxDepth, float looseness);
+
+	/// Allocates an SpatialPartitioner backed by the given SpatialPartitionerBackend and returns a handle.
+	/// SPATIAL_BACKEND_AUTO picks the backend from the observed workload and switches as it changes.
+	BLOCKSEXPORT int AllocSpatialPartitionerWithBackend(Vector3 center, Vector3 size, int backend);
+
+	/// Frees a SpatialPartitioner and its items. Handles are checked on every call, so calls with the freed
+	/// handle do nothing, and return 0 or -1, rather than reaching a partitioner that was allocated later. Any
+	/// SpatialPartitionerRead query still running on another thread finishes before the memory is released.
+	BLOCKSEXPORT void FreeSpatialPartitioner(int SpatialPartitionerHandle);
+
+	/// Returns the SpatialPartitionerBackend currently holding a SpatialPartitioner's items, or -1 for an unknown
+	/// or freed handle.
+	BLOCKSEXPORT int SpatialPartitionerGetBackend(int SpatialPartitionerHandle);
+
+	/// Returns the ScanKernelLevel of the scan kernels in use: 0 scalar, 1 SSE2, 2 AVX2 or 3 AVX-512. It is
+	/// picked from the CPU when the library loads.
+	BLOCKSEXPORT int SpatialPartitionerGetScanKernel();
+
+	/// Sets the number of worker threads that large queries, batched queries and the overlapping pair search
+	/// are split across, besides the calling thread. A negative count picks one fewer than the hardware threads,
+	/// which is the default, and 0 runs everything on the calling thread. Returns the count now in use. A host that
+	/// unloads the library before its process exits must call this with 0 first, which stops and joins the
+	/// workers; the library can't do so itself while it unloads.
+	BLOCKSEXPORT int SpatialPartitionerSetWorkerThreads(int count);
+
+	/// Sets the fewest items a query has to cover before it is split across the worker threads. Smaller queries
+	/// run on the calling thread alone, since waking the workers would cost more than they save.
+	BLOCKSEXPORT void SpatialPartitionerSetParallelThreshold(int minItems);
+
 	/// Allocates an SpatialPartitioner and returns a handle.
 	BLOCKSEXPORT void SpatialPartitionerAddItem(int SpatialPartitionerHandle, int itemId, Vector3 itemBoundsCenter, Vector3 itemBoundsExtents);
 
+	/// Adds count items to a SpatialPartitioner in one call, as ids with the bounds at the same positions in
+	/// centers and extents. Much faster than adding the items one by one when opening a model.
+	BLOCKSEXPORT void SpatialPartitionerBulkLoad(int SpatialPartitionerHandle, int* ids, Vector3* centers, Vector3* extents, int count);
+
+	/// Adds count items in one call, like SpatialPartitionerBulkLoad, which it pairs with SpatialPartitionerUpdateItems
+	/// and SpatialPartitionerRemoveItems. Ids that are already present are updated instead.
+	BLOCKSEXPORT void SpatialPartitionerAddItems(int SpatialPartitionerHandle, int* ids, Vector3* centers, Vector3* extents, int count);
+
+	/// Updates count items in one call, as ids with the bounds at the same positions in centers and extents. Moving a
+	/// group of items this way restructures the index once rather than once per item. Unknown ids are skipped.
+	BLOCKSEXPORT void SpatialPartitionerUpdateItems(int SpatialPartitionerHandle, int* ids, Vector3* centers, Vector3* extents, int count);
+
+	/// Removes count items in one call. Unknown ids are skipped.
+	BLOCKSEXPORT void SpatialPartitionerRemoveItems(int SpatialPartitionerHandle, int* ids, int count);
+
 	/// Allocates an SpatialPartitioner and returns a handle.
 	BLOCKSEXPORT void SpatialPartitionerUpdateItem(int SpatialPartitionerHandle, int itemId, Vector3 itemBoundsCenter, Vector3 itemBoundsExtents);
 
 	/// Allocates an SpatialPartitioner and returns a handle.
 	BLOCKSEXPORT void SpatialPartitionerRemoveItem(int SpatialPartitionerHandle, int itemId);
 
+	/// Turns deferred updates on, for a non-zero deferred, or off. While on, SpatialPartitionerAddItem,
+	/// SpatialPartitionerUpdateItem and SpatialPartitionerRemoveItem only queue their change, and repeated changes
+	/// to the same item replace each other in the queue. The queue is applied in one batch right before the next
+	/// query, batched change, snapshot or publish, on SpatialPartitionerFlushUpdates, or when deferred updates are
+	/// turned off. Use it while dragging, where an item moves several times between queries.
+	BLOCKSEXPORT void SpatialPartitionerSetDeferredUpdates(int SpatialPartitionerHandle, int deferred);
+
+	/// Applies the changes queued in deferred mode.
+	BLOCKSEXPORT void SpatialPartitionerFlushUpdates(int SpatialPartitionerHandle);
+
 	/// Allocates an SpatialPartitioner and returns a handle.
 	BLOCKSEXPORT int SpatialPartitionerContainedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize);
 
@@ -26,6 +83,132 @@ extern "C" {
 	/// Allocates an SpatialPartitioner and returns a handle.
 	BLOCKSEXPORT int SpatialPartitionerIntersectedByOrig(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize);
 
+	/// Like SpatialPartitionerContainedBy, but writes the total number of matching items to totalCount instead of
+	/// silently dropping the ones past returnArrayMaxSize. If they didn't all fit, *cursor receives a cursor to pass to
+	/// SpatialPartitionerNextPage for the rest, and otherwise -1. Up to 16 paged queries stay open at once; opening
+	/// another drops the oldest.
+	BLOCKSEXPORT int SpatialPartitionerContainedByPaged(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount);
+
+	/// Like SpatialPartitionerIntersectedBy, paged the same way as SpatialPartitionerContainedByPaged.
+	BLOCKSEXPORT int SpatialPartitionerIntersectedByPaged(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount);
+
+	/// Writes the next results of a paged query to returnArray and returns their number, without running the query
+	/// again. Sets *cursor to -1 after the last results. Returns -1 and sets *cursor to 0 if the cursor was dropped or
+	/// the items changed since the query ran, in which case the query has to be run again.
+	BLOCKSEXPORT int SpatialPartitionerNextPage(int SpatialPartitionerHandle, int* cursor, int* returnArray, int returnArrayMaxSize);
+
+	/// Drops the results of a paged query that won't be read to the end.
+	BLOCKSEXPORT void SpatialPartitionerReleaseCursor(int SpatialPartitionerHandle, int cursor);
+
+	/// Runs queryCount box queries in one call. Query i finds the items intersecting the box of centers[i] and extents[i],
+	/// or lying inside it if containedFlags[i] is non-zero; containedFlags may be null to intersect with every box. Its ids
+	/// are written to ids from offsets[i] up to offsets[i + 1], so offsets needs queryCount + 1 entries. Queries are
+	/// answered in order until one doesn't fit in what is left of ids; it and the queries after it get empty ranges.
+	/// Returns the number of queries answered. Queries whose boxes overlap share a single traversal of the index.
+	BLOCKSEXPORT int SpatialPartitionerBatchQuery(int SpatialPartitionerHandle, Vector3* centers, Vector3* extents, int* containedFlags, int queryCount, int* offsets, int* ids, int maxIds);
+
+	/// Returns 1 if the AABB defined by testCenter and testExtents fully contains any item, otherwise 0. Stops at the first
+	/// item found.
+	BLOCKSEXPORT int SpatialPartitionerAnyContainedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents);
+
+	/// Returns 1 if the AABB defined by testCenter and testExtents intersects any item, otherwise 0. Stops at the first item
+	/// found.
+	BLOCKSEXPORT int SpatialPartitionerAnyIntersectedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents);
+
+	/// Returns the number of items the AABB defined by testCenter and testExtents fully contains, without writing their ids.
+	BLOCKSEXPORT int SpatialPartitionerCountContainedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents);
+
+	/// Returns the number of items the AABB defined by testCenter and testExtents intersects, without writing their ids.
+	BLOCKSEXPORT int SpatialPartitionerCountIntersectedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents);
+
+	/// Casts a ray from origin along direction and writes the ids of up to maxHits items whose bounds it passes
+	/// through within maxDistance to hits, closest first, and the distance at which the ray enters each to
+	/// distances. Returns the number of hits.
+	BLOCKSEXPORT int SpatialPartitionerRaycast(int SpatialPartitionerHandle, Vector3 origin, Vector3 direction, float maxDistance, int* hits, float* distances, int maxHits);
+
+	/// Writes the ids of up to k items closest to point, by the distance from point to their bounds, to
+	/// returnArray, closest first, and their squared distances to squaredDistances. Only items within
+	/// maxDistance are returned; pass infinity for no limit. Returns the number of items written.
+	BLOCKSEXPORT int SpatialPartitionerNearest(int SpatialPartitionerHandle, Vector3 point, float maxDistance, int* returnArray, float* squaredDistances, int k);
+
+	/// Writes the ids of the items whose bounds come within radius of center to returnArray, stopping at
+	/// returnArrayMaxSize, and returns their count.
+	BLOCKSEXPORT int SpatialPartitionerSphereQuery(int SpatialPartitionerHandle, Vector3 center, float radius, int* returnArray, int returnArrayMaxSize);
+
+	/// Writes the ids of the items whose bounds come within radius of the segment from start to end to
+	/// returnArray, stopping at returnArrayMaxSize, and returns their count.
+	BLOCKSEXPORT int SpatialPartitionerCapsuleQuery(int SpatialPartitionerHandle, Vector3 start, Vector3 end, float radius, int* returnArray, int returnArrayMaxSize);
+
+	/// Writes the ids of the items whose bounds overlap a frustum to returnArray, stopping at returnArrayMaxSize,
+	/// and returns their count. planes holds six planes of four floats, a normal and a distance, laid out like
+	/// Unity's Plane, with the inside in front. If classifications isn't null, it receives 2 for each item inside
+	/// the frustum and 1 for each crossing its boundary. Boxes are tested plane by plane, as in view frustum
+	/// culling, so a box just outside an edge of the frustum can still be reported as crossing it. Items in
+	/// subtrees wholly inside are reported without being tested one by one.
+	BLOCKSEXPORT int SpatialPartitionerFrustumQuery(int SpatialPartitionerHandle, float* planes, int* returnArray, int* classifications, int returnArrayMaxSize);
+
+	/// Writes the ids of the items whose bounds intersect a rotated box to returnArray, stopping at
+	/// returnArrayMaxSize, and returns their count. The box has the given center and half extents, rotated by
+	/// the quaternion in rotation, four floats laid out like Unity's Quaternion.
+	BLOCKSEXPORT int SpatialPartitionerIntersectedByOrientedBox(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, float* rotation, int* returnArray, int returnArrayMaxSize);
+
+	/// Writes the ids of the items whose bounds lie inside a rotated box to returnArray, stopping at
+	/// returnArrayMaxSize, and returns their count. The box is given as for
+	/// SpatialPartitionerIntersectedByOrientedBox.
+	BLOCKSEXPORT int SpatialPartitionerContainedByOrientedBox(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, float* rotation, int* returnArray, int returnArrayMaxSize);
+
+	/// Writes up to maxPairs pairs of items whose bounds intersect to pairs, as two ids each, lower id first, and
+	/// returns the number of pairs written. Pass *cursor as 0 to start; on return it holds the value to pass to
+	/// fetch the next pairs, or -1 once all have been returned. The search runs on the thread pool on the first call.
+	/// Returns -1 and resets *cursor to 0 if the items changed between calls, and the search has to start over.
+	BLOCKSEXPORT int SpatialPartitionerFindOverlappingPairs(int SpatialPartitionerHandle, int* pairs, int maxPairs, int* cursor);
+
+	/// Publishes a SpatialPartitioner's items as they are now to the SpatialPartitionerRead queries. Publishing
+	/// copies only the items changed since the last publish. Call it from the thread that changes the items.
+	BLOCKSEXPORT void SpatialPartitionerPublish(int SpatialPartitionerHandle);
+
+	/// SpatialPartitionerContainedBy on the items as of the last SpatialPartitionerPublish, or on no items before
+	/// the first. The Read queries may run on any number of threads at once, including while another thread
+	/// changes or publishes the items, and never wait for it.
+	BLOCKSEXPORT int SpatialPartitionerReadContainedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize);
+
+	/// SpatialPartitionerIntersectedBy on the items as of the last SpatialPartitionerPublish.
+	BLOCKSEXPORT int SpatialPartitionerReadIntersectedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize);
+
+	/// SpatialPartitionerRaycast on the items as of the last SpatialPartitionerPublish.
+	BLOCKSEXPORT int SpatialPartitionerReadRaycast(int SpatialPartitionerHandle, Vector3 origin, Vector3 direction, float maxDistance, int* hits, float* distances, int maxHits);
+
+	/// SpatialPartitionerNearest on the items as of the last SpatialPartitionerPublish.
+	BLOCKSEXPORT int SpatialPartitionerReadNearest(int SpatialPartitionerHandle, Vector3 point, float maxDistance, int* returnArray, float* squaredDistances, int k);
+
+	/// Takes a snapshot of a SpatialPartitioner's items and returns a handle to it. Later changes to the items leave
+	/// the snapshot untouched, and it shares the pages of items unchanged since the last snapshot or publish, so
+	/// taking one copies only what changed. Call it from the thread that changes the items.
+	BLOCKSEXPORT int SpatialPartitionerSnapshot(int SpatialPartitionerHandle);
+
+	/// Releases a snapshot handle. The snapshot's memory is freed once no other snapshot shares it.
+	BLOCKSEXPORT void FreeSpatialSnapshot(int SpatialSnapshotHandle);
+
+	/// Returns the number of items in a snapshot, or 0 for an unknown handle.
+	BLOCKSEXPORT int SpatialSnapshotItemCount(int SpatialSnapshotHandle);
+
+	/// Returns the version of the SpatialPartitioner a snapshot was taken at, or -1 for an unknown handle. Two
+	/// snapshots of the same partitioner with the same version hold the same items.
+	BLOCKSEXPORT long long SpatialSnapshotGetVersion(int SpatialSnapshotHandle);
+
+	/// SpatialPartitionerContainedBy on the items of a snapshot. The snapshot queries may run on any thread, and
+	/// return 0 for an unknown handle.
+	BLOCKSEXPORT int SpatialSnapshotContainedBy(int SpatialSnapshotHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize);
+
+	/// SpatialPartitionerIntersectedBy on the items of a snapshot.
+	BLOCKSEXPORT int SpatialSnapshotIntersectedBy(int SpatialSnapshotHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize);
+
+	/// SpatialPartitionerRaycast on the items of a snapshot.
+	BLOCKSEXPORT int SpatialSnapshotRaycast(int SpatialSnapshotHandle, Vector3 origin, Vector3 direction, float maxDistance, int* hits, float* distances, int maxHits);
+
+	/// SpatialPartitionerNearest on the items of a snapshot.
+	BLOCKSEXPORT int SpatialSnapshotNearest(int SpatialSnapshotHandle, Vector3 point, float maxDistance, int* returnArray, float* squaredDistances, int k);
+
 	/// Allocates an SpatialPartitioner and returns a handle.
 	BLOCKSEXPORT void SpatialPartitionerHasItem(int SpatialPartitionerHandle, int itemHandle);
 }
\ No newline at end of file
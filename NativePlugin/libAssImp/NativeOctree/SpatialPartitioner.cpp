@@ -1,126 +1,457 @@
 #include "SpatialPartitioner.h"
+#include "DynamicAABBTree.h"
+#include "LooseOctree.h"
+#include "SweepAndPrune.h"
+#include "HashedGrid.h"
+#include "LinearScan.h"
+#include "QuantizedScan.h"
+#include "QueryShapes.h"
+#include "OverlapPairs.h"
+#include "ThreadPool.h"
+#include "EpochReclaimer.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <xmmintrin.h> //SSE
 #include <emmintrin.h> //SSE2
 
-SpatialPartitioner::SpatialPartitioner() {
+/// Number of adds, updates, removes and queries between two automatic backend selections.
+static const int kSelectionInterval = 1024;
 
-};
+/// Automatically backed partitioners with at most this many items are scanned linearly.
+static const int kLinearScanMaxItems = 64;
+
+/// Largest ratio between the sizes of large and small items for which a hashed grid is chosen, since items
+/// much larger than their neighbours make grid queries visit many cells.
+static const float kGridMaxSizeSpread = 8.0f;
+
+/// Least number of adds, updates and removes per query for which a hashed grid is chosen over the BVH.
+static const float kGridMinUpdateRatio = 4.0f;
+
+/// Number of items sampled when estimating the spread of item sizes.
+static const int kSizeSamples = 256;
 
-bool intersects(AABB &volume0, AABB &volume1) {
-	/* This is an implementation of AABB intersection using SSE/SSE2 SIMD instructions.
-	This is the non-SIMD code for what it is implementing:
-	if (volume0.max.x < volume1.min.x || volume0.min.x > volume1.max.x) return 0;
-	if (volume0.max.y < volume1.min.y || volume0.min.y > volume1.max.y) return 0;
-	if (volume0.max.z < volume1.min.z || volume0.min.z > volume1.max.z) return 0;
-	return 1;*/
-	__m128 temp = _mm_cmplt_ps(volume0.vecmax, volume1.vecmin);
-	__m128 temp2 = _mm_cmpgt_ps(volume0.vecmin, volume1.vecmax);
-	temp = _mm_or_ps(temp, temp2);
-	return (_mm_movemask_ps(temp) & 7) <= 0;
+/// Most paged queries kept open at once. Opening another drops the oldest, whose cursor then reads as unknown.
+static const size_t kMaxPagedQueries = 16;
 
+/// Creates the index for backend over the given world volume.
+static SpatialIndex* CreateIndex(SpatialPartitionerBackend backend, Vector3 worldCenter, Vector3 worldSize) {
+	switch (backend) {
+	case SPATIAL_BACKEND_OCTREE:
+		return new LooseOctree(worldCenter, worldSize);
+	case SPATIAL_BACKEND_SWEEP_AND_PRUNE:
+		return new SweepAndPrune();
+	case SPATIAL_BACKEND_HASHED_GRID:
+		return new HashedGrid();
+	case SPATIAL_BACKEND_LINEAR:
+		return new LinearScan();
+	case SPATIAL_BACKEND_QUANTIZED:
+		return new QuantizedScan(worldCenter, worldSize);
+	default:
+		return new DynamicAABBTree();
+	}
 }
 
+/// Returns the ratio between the 90th and 10th percentile of the items' largest dimension, estimated from an
+/// evenly strided sample of the items.
+static float SizeSpread(const std::vector<AABB>& elements) {
+	if (elements.empty()) return 1;
+	size_t stride = std::max(elements.size() / kSizeSamples, (size_t)1);
+	std::vector<float> sizes;
+	sizes.reserve(kSizeSamples + 1);
+	for (size_t i = 0; i < elements.size(); i += stride) {
+		float size[4];
+		_mm_storeu_ps(size, _mm_sub_ps(elements[i].vecmax, elements[i].vecmin));
+		sizes.push_back(std::max(size[0], std::max(size[1], size[2])));
+	}
+	size_t small = sizes.size() / 10;
+	size_t large = sizes.size() * 9 / 10;
+	std::nth_element(sizes.begin(), sizes.begin() + small, sizes.end());
+	float smallSize = sizes[small];
+	std::nth_element(sizes.begin(), sizes.begin() + large, sizes.end());
+	float largeSize = sizes[large];
+	if (!(smallSize > 0)) return largeSize > 0 ? FLT_MAX : 1;
+	return largeSize / smallSize;
+}
+
+/// Picks a backend for itemCount items whose sizes spread by sizeSpread, changed updateRatio times per query.
+static SpatialPartitionerBackend ChooseBackend(int itemCount, float sizeSpread, float updateRatio) {
+	if (itemCount <= kLinearScanMaxItems) return SPATIAL_BACKEND_LINEAR;
+	if (sizeSpread <= kGridMaxSizeSpread && updateRatio >= kGridMinUpdateRatio) return SPATIAL_BACKEND_HASHED_GRID;
+	return SPATIAL_BACKEND_BVH;
+}
+
+SpatialPartitioner::SpatialPartitioner() : SpatialPartitioner(Vector3(), Vector3(), SPATIAL_BACKEND_BVH) {
+
+};
+
+SpatialPartitioner::SpatialPartitioner(Vector3 worldCenter, Vector3 worldSize) :
+	SpatialPartitioner(worldCenter, worldSize,
+		worldSize.x > 0 && worldSize.y > 0 && worldSize.z > 0 ? SPATIAL_BACKEND_OCTREE : SPATIAL_BACKEND_BVH) {
+
+};
+
+SpatialPartitioner::SpatialPartitioner(Vector3 worldCenter, Vector3 worldSize, int octreeMaxDepth, float octreeLooseness) :
+	SpatialPartitioner(worldCenter, worldSize, SPATIAL_BACKEND_OCTREE,
+		new LooseOctree(worldCenter, worldSize, octreeMaxDepth, octreeLooseness)) {
+
+};
+
+SpatialPartitioner::SpatialPartitioner(Vector3 worldCenter, Vector3 worldSize, SpatialPartitionerBackend backend) :
+	SpatialPartitioner(worldCenter, worldSize, backend, nullptr) {
+
+};
+
+/// Takes ownership of index, or creates the backend's default index if it is nullptr.
+SpatialPartitioner::SpatialPartitioner(Vector3 worldCenter, Vector3 worldSize, SpatialPartitionerBackend backend, SpatialIndex* index) :
+	index(index), worldCenter(worldCenter), worldSize(worldSize), updateCount(0), queryCount(0), version(0), pairVersion(0), nextCursor(1),
+	published(nullptr), deferUpdates(false) {
+	if (backend < SPATIAL_BACKEND_BVH || backend > SPATIAL_BACKEND_QUANTIZED) {
+		backend = SPATIAL_BACKEND_BVH;
+	}
+	autoSelect = backend == SPATIAL_BACKEND_AUTO;
+	this->backend = autoSelect ? SPATIAL_BACKEND_LINEAR : backend;
+	pendingBackend = this->backend;
+	if (!this->index) {
+		this->index.reset(CreateIndex(this->backend, worldCenter, worldSize));
+	}
+};
+
+/// Unpublishes the snapshot and waits for any readers still on it.
+SpatialPartitioner::~SpatialPartitioner() {
+	published = nullptr;
+	EpochReclaimer& reclaimer = EpochReclaimer::Instance();
+	reclaimer.WaitForReaders(reclaimer.Advance());
+};
+
+/// Counts operations towards the next automatic backend selection.
+void SpatialPartitioner::CountOperations(int updates, int queries) {
+	if (!autoSelect) return;
+	updateCount += updates;
+	queryCount += queries;
+	if (updateCount + queryCount >= kSelectionInterval) {
+		SelectBackend();
+	}
+};
+
+/// Picks the backend that suits the workload seen since the last selection, and moves the items to it. A
+/// different backend has to be picked twice in a row before the items move, so a workload on the edge between
+/// two backends doesn't rebuild the index every interval. Only outgrowing the linear scan migrates at once.
+void SpatialPartitioner::SelectBackend() {
+	float updateRatio = queryCount > 0 ? (float)updateCount / queryCount : (float)updateCount;
+	updateCount = 0;
+	queryCount = 0;
+	int itemCount = (int)elementVector.size();
+	SpatialPartitionerBackend chosen = ChooseBackend(itemCount, SizeSpread(elementVector), updateRatio);
+	bool outgrown = backend == SPATIAL_BACKEND_LINEAR && itemCount > kLinearScanMaxItems;
+	if (chosen != backend && (chosen == pendingBackend || outgrown)) {
+		MigrateTo(chosen);
+	}
+	pendingBackend = chosen;
+};
+
+/// Rebuilds the index as backend from elementVector.
+void SpatialPartitioner::MigrateTo(SpatialPartitionerBackend backend) {
+	index.reset(CreateIndex(backend, worldCenter, worldSize));
+	if (!elementVector.empty()) {
+		index->InsertMany(&elementVector[0], (int)elementVector.size(), &proxyVector[0]);
+	}
+	this->backend = backend;
+};
+
+/// Returns the backend currently holding the items.
+SpatialPartitionerBackend SpatialPartitioner::GetBackend() const {
+	return backend;
+};
+
 bool intersectsOrig(AABB &volume0, AABB &volume1) {
+	// Spilled to arrays rather than read through m128_f32, which only MSVC provides.
+	float min0[4], max0[4], min1[4], max1[4];
+	_mm_storeu_ps(min0, volume0.vecmin);
+	_mm_storeu_ps(max0, volume0.vecmax);
+	_mm_storeu_ps(min1, volume1.vecmin);
+	_mm_storeu_ps(max1, volume1.vecmax);
 	for (int i = 0; i < 3; i++) {
-		if (volume0.vecmax.m128_f32[i] < volume1.vecmin.m128_f32[i] || volume0.vecmin.m128_f32[i] > volume1.vecmax.m128_f32[i]) return 0;
+		if (max0[i] < min1[i] || min0[i] > max1[i]) return 0;
 	}
 	return 1;
 
 }
 
-int contains(AABB &volume0, AABB &volume1) {
-	// SSE implementation of the below scalar check.
-	// Checks whether the volume1 AABB is completely contained within the volume0 AABB.
-	/*if (volume0.min.x > volume1.min.x || volume0.max.x < volume1.max.x) return 0;
-	if (volume0.min.y > volume1.min.y || volume0.max.y < volume1.max.y) return 0;
-	if (volume0.min.z > volume1.min.z || volume0.max.z < volume1.max.z) return 0;*/
-	__m128 temp = _mm_cmpgt_ps(volume0.vecmin, volume1.vecmin);
-	__m128 temp2 = _mm_cmplt_ps(volume0.vecmax, volume1.vecmax);
-	temp = _mm_or_ps(temp, temp2);
-	return (_mm_movemask_ps(temp) & 7) <= 0;
-}
-
 /// Adds an item as itemId with the specified bounds.
 void SpatialPartitioner::AddItem(int itemId, Vector3 &itemBoundsCenter, Vector3 &itemBoundsSize) {
-	idToIndex[itemId] = (int)elementVector.size();
-	elementVector.push_back(AABB(itemId, itemBoundsCenter, itemBoundsSize));
+	if (deferUpdates) {
+		QueueUpdate(itemId, itemBoundsCenter, itemBoundsSize, true);
+		return;
+	}
+	if (idToIndex.Find(itemId) != ItemIdMap::kMissing) {
+		// Re-adding an id would otherwise leave its previous entry behind in the index.
+		UpdateItem(itemId, itemBoundsCenter, itemBoundsSize);
+		return;
+	}
+	AABB box = AABB(itemId, itemBoundsCenter, itemBoundsSize);
+	idToIndex.Set(itemId, (int)elementVector.size());
+	elementVector.push_back(box);
+	proxyVector.push_back(index->Insert(itemId, box));
+	snapshots.MarkChanged(elementVector.size() - 1);
+	version++;
+	CountOperations(1, 0);
 };
 
-/// Updates an item with the specified id.
-void SpatialPartitioner::UpdateItem(int itemId, Vector3 itemBoundsCenter, Vector3 itemBoundsSize) {
-	int index = idToIndex[itemId];
-	elementVector[index] = AABB(itemId, itemBoundsCenter, itemBoundsSize);
+/// Adds count items at once, as itemIds with the bounds at the same positions in centers and extents. Ids
+/// that are already present are updated instead.
+void SpatialPartitioner::BulkLoad(const int* itemIds, const Vector3* centers, const Vector3* extents, int count) {
+	FlushUpdates();
+	size_t firstNew = elementVector.size();
+	elementVector.reserve(firstNew + count);
+	idToIndex.Reserve(idToIndex.Size() + count);
+	std::vector<int> updatedIds;
+	std::vector<Vector3> updatedCenters;
+	std::vector<Vector3> updatedExtents;
+	for (int i = 0; i < count; i++) {
+		int found = idToIndex.Find(itemIds[i]);
+		if (found == ItemIdMap::kMissing) {
+			idToIndex.Set(itemIds[i], (int)elementVector.size());
+			elementVector.push_back(AABB(itemIds[i], centers[i], extents[i]));
+		}
+		else if ((size_t)found >= firstNew) {
+			// A repeated id within the batch keeps its last bounds.
+			elementVector[found] = AABB(itemIds[i], centers[i], extents[i]);
+		}
+		else {
+			updatedIds.push_back(itemIds[i]);
+			updatedCenters.push_back(centers[i]);
+			updatedExtents.push_back(extents[i]);
+		}
+	}
+	proxyVector.resize(elementVector.size());
+	snapshots.MarkChanged(firstNew, elementVector.size());
+	int newCount = (int)(elementVector.size() - firstNew);
+	if (newCount > 0) {
+		index->InsertMany(&elementVector[firstNew], newCount, &proxyVector[firstNew]);
+		version++;
+	}
+	CountOperations(newCount, 0);
+	// Only now that the new items are in the index, since counting the updates can migrate it.
+	if (!updatedIds.empty()) {
+		UpdateItems(updatedIds.data(), updatedCenters.data(), updatedExtents.data(), (int)updatedIds.size());
+	}
 };
 
-/// Extracts the integer id from the component of the float vector that its bits are stored in.
-/// Implemented via magic.
-int32_t IdFromAABB(AABB& box) {
-	__m128 temp = _mm_shuffle_ps(box.vecmax, box.vecmax, _MM_SHUFFLE(3, 3, 3, 3));
-	return _mm_cvtsi128_si32(_mm_castps_si128(temp));
-}
+/// Updates an item with the specified id. Unknown ids are ignored.
+void SpatialPartitioner::UpdateItem(int itemId, Vector3 itemBoundsCenter, Vector3 itemBoundsSize) {
+	if (deferUpdates) {
+		QueueUpdate(itemId, itemBoundsCenter, itemBoundsSize, false);
+		return;
+	}
+	int elementIndex = idToIndex.Find(itemId);
+	if (elementIndex == ItemIdMap::kMissing) return;
+	elementVector[elementIndex] = AABB(itemId, itemBoundsCenter, itemBoundsSize);
+	index->Update(proxyVector[elementIndex], elementVector[elementIndex]);
+	snapshots.MarkChanged(elementIndex);
+	version++;
+	CountOperations(1, 0);
+};
 
-/// Removes an item with the specified id.
+/// Removes an item with the specified id. Unknown ids are ignored.
 void SpatialPartitioner::RemoveItem(int itemId) {
+	if (deferUpdates) {
+		QueueRemove(itemId);
+		return;
+	}
+	int found = idToIndex.Find(itemId);
+	if (found == ItemIdMap::kMissing) return;
+	version++;
+	CountOperations(1, 0);
 	if (elementVector.size() > 1) {
-		size_t index = idToIndex[itemId];
-		if (index == elementVector.size() - 1) {
-			idToIndex.erase(itemId);
+		size_t elementIndex = found;
+		index->Remove(proxyVector[elementIndex]);
+		snapshots.MarkChanged(elementIndex);
+		snapshots.MarkChanged(elementVector.size() - 1);
+		if (elementIndex == elementVector.size() - 1) {
+			idToIndex.Erase(itemId);
 			elementVector.pop_back();
+			proxyVector.pop_back();
 			return;
 		}
 		int lastId = IdFromAABB(elementVector[elementVector.size() - 1]);
-		elementVector[index] = elementVector[elementVector.size() - 1];
+		elementVector[elementIndex] = elementVector[elementVector.size() - 1];
 		elementVector.pop_back();
-		idToIndex.erase(itemId);
-		idToIndex[lastId] = index;
+		proxyVector[elementIndex] = proxyVector[proxyVector.size() - 1];
+		proxyVector.pop_back();
+		idToIndex.Erase(itemId);
+		idToIndex.Set(lastId, (int)elementIndex);
 	}
 	else {
+		snapshots.MarkChanged(0, elementVector.size());
 		elementVector.clear();
-		idToIndex.clear();
+		proxyVector.clear();
+		idToIndex.Clear();
+		index->Clear();
+	}
+};
+
+/// Updates count items at once, with the bounds at the same positions in centers and extents, and lets the index
+/// restructure once for all of them. Ids that aren't present are skipped.
+void SpatialPartitioner::UpdateItems(const int* itemIds, const Vector3* centers, const Vector3* extents, int count) {
+	FlushUpdates();
+	std::vector<int> proxies;
+	std::vector<AABB> bounds;
+	proxies.reserve(count);
+	bounds.reserve(count);
+	for (int i = 0; i < count; i++) {
+		int found = idToIndex.Find(itemIds[i]);
+		if (found == ItemIdMap::kMissing) continue;
+		elementVector[found] = AABB(itemIds[i], centers[i], extents[i]);
+		snapshots.MarkChanged(found);
+		proxies.push_back(proxyVector[found]);
+		bounds.push_back(elementVector[found]);
+	}
+	if (!proxies.empty()) {
+		index->UpdateMany(proxies.data(), bounds.data(), (int)proxies.size());
+		version++;
+	}
+	CountOperations((int)proxies.size(), 0);
+};
+
+/// Removes count items at once, and lets the index restructure once for all of them. Ids that aren't present are
+/// skipped.
+void SpatialPartitioner::RemoveItems(const int* itemIds, int count) {
+	FlushUpdates();
+	std::vector<int> proxies;
+	proxies.reserve(count);
+	for (int i = 0; i < count; i++) {
+		int found = idToIndex.Find(itemIds[i]);
+		if (found == ItemIdMap::kMissing) continue;
+		size_t elementIndex = found;
+		proxies.push_back(proxyVector[elementIndex]);
+		idToIndex.Erase(itemIds[i]);
+		snapshots.MarkChanged(elementIndex);
+		snapshots.MarkChanged(elementVector.size() - 1);
+		if (elementIndex != elementVector.size() - 1) {
+			elementVector[elementIndex] = elementVector.back();
+			proxyVector[elementIndex] = proxyVector.back();
+			idToIndex.Set(IdFromAABB(elementVector[elementIndex]), (int)elementIndex);
+		}
+		elementVector.pop_back();
+		proxyVector.pop_back();
+	}
+	if (!proxies.empty()) {
+		if (elementVector.empty()) {
+			index->Clear();
+		}
+		else {
+			index->RemoveMany(proxies.data(), (int)proxies.size());
+		}
+		version++;
+	}
+	CountOperations((int)proxies.size(), 0);
+};
+
+/// Queues AddItem, UpdateItem and RemoveItem instead of applying them while deferred is true, and applies the
+/// queue once turned off.
+void SpatialPartitioner::SetDeferredUpdates(bool deferred) {
+	if (!deferred) {
+		FlushUpdates();
+	}
+	deferUpdates = deferred;
+};
+
+/// Applies the queued changes with one RemoveItems and one BulkLoad, which updates the items already present.
+/// Each id is queued once, so the order within the queue doesn't matter.
+void SpatialPartitioner::FlushUpdates() {
+	if (pendingUpdates.empty()) return;
+	// Taken out of the queue first, since RemoveItems and BulkLoad flush it themselves.
+	std::vector<PendingUpdate> queued;
+	queued.swap(pendingUpdates);
+	std::vector<int> removedIds;
+	std::vector<int> ids;
+	std::vector<Vector3> centers;
+	std::vector<Vector3> extents;
+	ids.reserve(queued.size());
+	centers.reserve(queued.size());
+	extents.reserve(queued.size());
+	for (size_t i = 0; i < queued.size(); i++) {
+		const PendingUpdate& update = queued[i];
+		pendingIndex.Erase(update.itemId);
+		if (update.present) {
+			ids.push_back(update.itemId);
+			centers.push_back(update.center);
+			extents.push_back(update.extents);
+		}
+		else if (idToIndex.Find(update.itemId) != ItemIdMap::kMissing) {
+			removedIds.push_back(update.itemId);
+		}
 	}
+	if (!removedIds.empty()) {
+		RemoveItems(removedIds.data(), (int)removedIds.size());
+	}
+	if (!ids.empty()) {
+		BulkLoad(ids.data(), centers.data(), extents.data(), (int)ids.size());
+	}
+	// Keeps the queue's memory for the next round.
+	queued.clear();
+	pendingUpdates.swap(queued);
+};
+
+/// Queues the bounds of an add, or of an update, which is dropped if the item won't be present by then.
+void SpatialPartitioner::QueueUpdate(int itemId, Vector3 center, Vector3 extents, bool add) {
+	int pending = pendingIndex.Find(itemId);
+	bool present = pending != ItemIdMap::kMissing ? pendingUpdates[pending].present : idToIndex.Find(itemId) != ItemIdMap::kMissing;
+	if (!add && !present) return;
+	if (pending == ItemIdMap::kMissing) {
+		pending = (int)pendingUpdates.size();
+		pendingIndex.Set(itemId, pending);
+		pendingUpdates.push_back(PendingUpdate());
+	}
+	PendingUpdate& update = pendingUpdates[pending];
+	update.itemId = itemId;
+	update.present = true;
+	update.center = center;
+	update.extents = extents;
+};
+
+/// Queues a removal, which replaces any change queued for the item before.
+void SpatialPartitioner::QueueRemove(int itemId) {
+	int pending = pendingIndex.Find(itemId);
+	if (pending == ItemIdMap::kMissing) {
+		if (idToIndex.Find(itemId) == ItemIdMap::kMissing) return;
+		pending = (int)pendingUpdates.size();
+		pendingIndex.Set(itemId, pending);
+		pendingUpdates.push_back(PendingUpdate());
+	}
+	PendingUpdate& update = pendingUpdates[pending];
+	update.itemId = itemId;
+	update.present = false;
 };
 
 /// Tests whether the AABB defined by testCenter and testExtents fully contains any elements, and returns them in the supplied array
 /// which must already be allocated.
 int SpatialPartitioner::ContainedBy(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
 	int id = -1;
 	AABB testAABB = AABB(id, testCenter, testExtents);
-	int curNumResults = 0;
-	for (auto it = elementVector.begin(); it != elementVector.end(); ++it) {
-		if (contains(testAABB, *it)) {
-			returnArray[curNumResults] = IdFromAABB(*it);
-			curNumResults++;
-			if (curNumResults >= returnArrayMaxSize) return curNumResults;
-		}
-	}
-	return curNumResults;
+	CountOperations(0, 1);
+	return index->ContainedBy(testAABB, returnArray, returnArrayMaxSize);
 };
 
-int isectStarted = 0;
 /// Tests whether the AABB defined by testCenter and testExtents intersects any elements, and returns them in the supplied array
 /// which must already be allocated.
 int SpatialPartitioner::IntersectedBy(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
 	int id = -1;
-
 	AABB testAABB = AABB(id, testCenter, testExtents);
-	int curNumResults = 0;
-	for (auto it = elementVector.begin(); it != elementVector.end(); ++it) {
-		if (intersects(testAABB, *it)) {
-			int isectId = IdFromAABB(*it);
-			returnArray[curNumResults] = isectId;
-			curNumResults++;
-			if (curNumResults >= returnArrayMaxSize) return curNumResults;
-		}
-	}
-	return curNumResults;
+	CountOperations(0, 1);
+	return index->IntersectedBy(testAABB, returnArray, returnArrayMaxSize);
 };
 
 /// Tests whether the AABB defined by testCenter and testExtents intersects any elements, and returns them in the supplied array
-/// which must already be allocated.
+/// which must already be allocated. This is the reference linear scan the index queries can be checked against.
 int SpatialPartitioner::IntersectedByOrig(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
 	int id = -1;
 	AABB testAABB = AABB(id, testCenter, testExtents);
 	int curNumResults = 0;
@@ -135,7 +466,382 @@ int SpatialPartitioner::IntersectedByOrig(Vector3 testCenter, Vector3 testExtent
 	return curNumResults;
 };
 
+/// Like ContainedBy, but reports the total number of matches and keeps the ones that don't fit for NextPage.
+int SpatialPartitioner::ContainedByPaged(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount) {
+	int id = -1;
+	AABB testAABB = AABB(id, testCenter, testExtents);
+	return QueryPaged(testAABB, true, returnArray, returnArrayMaxSize, cursor, totalCount);
+};
+
+/// Like IntersectedBy, but reports the total number of matches and keeps the ones that don't fit for NextPage.
+int SpatialPartitioner::IntersectedByPaged(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount) {
+	int id = -1;
+	AABB testAABB = AABB(id, testCenter, testExtents);
+	return QueryPaged(testAABB, false, returnArray, returnArrayMaxSize, cursor, totalCount);
+};
+
+/// Collects the results in one traversal, filling returnArray first. The ones that don't fit wait in the open
+/// query for NextPage.
+int SpatialPartitioner::QueryPaged(const AABB& testBounds, bool contained, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount) {
+	FlushUpdates();
+	CountOperations(0, 1);
+	PagedQuery query;
+	BoxCollector collector(testBounds, contained, returnArray, std::max(returnArrayMaxSize, 0), query.ids);
+	index->Traverse(collector);
+	int count = collector.Count();
+	*totalCount = count + (int)query.ids.size();
+	if (query.ids.empty()) {
+		*cursor = -1;
+		return count;
+	}
+
+	query.ids.shrink_to_fit();
+	query.cursor = nextCursor;
+	query.version = version;
+	query.next = 0;
+	if (pagedQueries.size() >= kMaxPagedQueries) {
+		pagedQueries.erase(pagedQueries.begin());
+	}
+	pagedQueries.push_back(std::move(query));
+	*cursor = nextCursor;
+	nextCursor = nextCursor == INT_MAX ? 1 : nextCursor + 1;
+	return count;
+};
+
+/// Continues a paged query from where the last page ended.
+int SpatialPartitioner::NextPage(int* cursor, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
+	if (*cursor < 0) return 0;
+	auto query = std::find_if(pagedQueries.begin(), pagedQueries.end(),
+		[&](const PagedQuery& open) { return open.cursor == *cursor; });
+	if (query == pagedQueries.end() || query->version != version) {
+		if (query != pagedQueries.end()) {
+			pagedQueries.erase(query);
+		}
+		*cursor = 0;
+		return -1;
+	}
+
+	int count = (int)std::min(query->ids.size() - query->next, (size_t)std::max(returnArrayMaxSize, 0));
+	std::copy(query->ids.begin() + query->next, query->ids.begin() + query->next + count, returnArray);
+	query->next += count;
+	if (query->next >= query->ids.size()) {
+		pagedQueries.erase(query);
+		*cursor = -1;
+	}
+	return count;
+};
+
+/// Drops the results of a paged query that won't be read to the end.
+void SpatialPartitioner::ReleaseCursor(int cursor) {
+	auto query = std::find_if(pagedQueries.begin(), pagedQueries.end(),
+		[&](const PagedQuery& open) { return open.cursor == cursor; });
+	if (query != pagedQueries.end()) {
+		pagedQueries.erase(query);
+	}
+};
+
+/// Groups the queries whose boxes overlap, directly or through other boxes, and answers each group of several
+/// queries with one traversal. Queries overlapping no other run alone, straight into returnArray.
+int SpatialPartitioner::BatchQuery(const Vector3* centers, const Vector3* extents, const int* containedFlags, int queryCount,
+	int* offsets, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
+	CountOperations(0, std::max(queryCount, 0));
+	offsets[0] = 0;
+	if (queryCount <= 0) return 0;
+
+	int id = -1;
+	std::vector<AABB> queries;
+	queries.reserve(queryCount);
+	for (int i = 0; i < queryCount; i++) {
+		queries.push_back(AABB(id, centers[i], extents[i]));
+	}
+
+	// Union-find over the queries, linking every overlapping pair.
+	std::vector<int> groups(queryCount);
+	for (int i = 0; i < queryCount; i++) {
+		groups[i] = i;
+	}
+	auto findGroup = [&](int query) {
+		while (groups[query] != query) {
+			groups[query] = groups[groups[query]];
+			query = groups[query];
+		}
+		return query;
+	};
+	for (int i = 1; i < queryCount; i++) {
+		for (int j = 0; j < i; j++) {
+			if (!intersects(queries[i], queries[j])) continue;
+			int groupI = findGroup(i);
+			int groupJ = findGroup(j);
+			if (groupI != groupJ) {
+				groups[std::max(groupI, groupJ)] = std::min(groupI, groupJ);
+			}
+		}
+	}
+	std::vector<int> groupSizes(queryCount, 0);
+	for (int i = 0; i < queryCount; i++) {
+		groupSizes[findGroup(i)]++;
+	}
+
+	// Gathers each group of several queries in a batch, and runs the batches. Over enough items the batches run
+	// on the thread pool, and then lone queries get a batch of their own too, rather than writing their results
+	// straight to returnArray.
+	ThreadPool& pool = ThreadPool::Instance();
+	bool parallel = queryCount > 1 && pool.RunsInParallel(elementVector.size());
+	int minBatchSize = parallel ? 1 : 2;
+	std::vector<BoxBatch> batches;
+	std::vector<int> groupBatches(queryCount, -1);
+	std::vector<int> queryBatches(queryCount, -1);
+	for (int i = 0; i < queryCount; i++) {
+		int group = findGroup(i);
+		if (groupSizes[group] < minBatchSize) continue;
+		if (groupBatches[group] < 0) {
+			groupBatches[group] = (int)batches.size();
+			batches.push_back(BoxBatch());
+		}
+		queryBatches[i] = groupBatches[group];
+		batches[queryBatches[i]].Add(queries[i], containedFlags != nullptr && containedFlags[i] != 0);
+	}
+	if (parallel) {
+		index->Prepare();
+		pool.ParallelFor((int)batches.size(), 1, [&](int first, int last) {
+			for (int i = first; i < last; i++) {
+				index->Traverse(batches[i]);
+			}
+		});
+	}
+	else {
+		for (size_t i = 0; i < batches.size(); i++) {
+			index->Traverse(batches[i]);
+		}
+	}
+
+	// Members of a batch were added in query order, so they are read back in the same order.
+	std::vector<int> nextMembers(batches.size(), 0);
+	int written = 0;
+	int answered = 0;
+	for (; answered < queryCount; answered++) {
+		int remaining = std::max(returnArrayMaxSize - written, 0);
+		int batch = queryBatches[answered];
+		if (batch >= 0) {
+			const std::vector<int>& results = batches[batch].Results(nextMembers[batch]++);
+			if ((int)results.size() > remaining) break;
+			std::copy(results.begin(), results.end(), returnArray + written);
+			written += (int)results.size();
+		}
+		else {
+			bool contained = containedFlags != nullptr && containedFlags[answered] != 0;
+			const AABB& query = queries[answered];
+			int count = 0;
+			if (remaining > 0) {
+				count = contained ? index->ContainedBy(query, returnArray + written, remaining)
+					: index->IntersectedBy(query, returnArray + written, remaining);
+			}
+			// A full remainder may have cut the results short.
+			if (count == remaining && index->Count(query, contained, remaining + 1) > count) break;
+			written += count;
+		}
+		offsets[answered + 1] = written;
+	}
+	for (int i = answered; i < queryCount; i++) {
+		offsets[i + 1] = written;
+	}
+	return answered;
+};
+
+/// Tests whether the AABB defined by testCenter and testExtents fully contains any elements, stopping at the first.
+bool SpatialPartitioner::AnyContainedBy(Vector3 testCenter, Vector3 testExtents) {
+	FlushUpdates();
+	int id = -1;
+	AABB testAABB = AABB(id, testCenter, testExtents);
+	CountOperations(0, 1);
+	return index->Count(testAABB, true, 1) > 0;
+};
+
+/// Tests whether the AABB defined by testCenter and testExtents intersects any elements, stopping at the first.
+bool SpatialPartitioner::AnyIntersectedBy(Vector3 testCenter, Vector3 testExtents) {
+	FlushUpdates();
+	int id = -1;
+	AABB testAABB = AABB(id, testCenter, testExtents);
+	CountOperations(0, 1);
+	return index->Count(testAABB, false, 1) > 0;
+};
+
+/// Returns the number of elements the AABB defined by testCenter and testExtents fully contains, without writing their ids.
+int SpatialPartitioner::CountContainedBy(Vector3 testCenter, Vector3 testExtents) {
+	FlushUpdates();
+	int id = -1;
+	AABB testAABB = AABB(id, testCenter, testExtents);
+	CountOperations(0, 1);
+	return index->Count(testAABB, true, INT_MAX);
+};
+
+/// Returns the number of elements the AABB defined by testCenter and testExtents intersects, without writing their ids.
+int SpatialPartitioner::CountIntersectedBy(Vector3 testCenter, Vector3 testExtents) {
+	FlushUpdates();
+	int id = -1;
+	AABB testAABB = AABB(id, testCenter, testExtents);
+	CountOperations(0, 1);
+	return index->Count(testAABB, false, INT_MAX);
+};
+
+/// Casts a ray from origin along direction and returns up to maxHits of the items whose bounds it passes
+/// through within maxDistance, closest first, with the distance at which the ray enters each in distanceArray.
+int SpatialPartitioner::Raycast(Vector3 origin, Vector3 direction, float maxDistance, int* hitArray, float* distanceArray, int maxHits) {
+	FlushUpdates();
+	RayQuery ray(origin, direction, maxDistance, maxHits);
+	CountOperations(0, 1);
+	index->TraverseNearest(ray);
+	return ray.Write(hitArray, distanceArray);
+};
+
+/// Returns up to maxCount of the items closest to point, closest first, with their squared distances in
+/// squaredDistanceArray.
+int SpatialPartitioner::Nearest(Vector3 point, float maxDistance, int* returnArray, float* squaredDistanceArray, int maxCount) {
+	FlushUpdates();
+	PointQuery query(point, maxDistance, maxCount);
+	CountOperations(0, 1);
+	index->TraverseNearest(query);
+	return query.Write(returnArray, squaredDistanceArray);
+};
+
+/// Returns the items whose bounds come within radius of center in the supplied array, which must already be
+/// allocated.
+int SpatialPartitioner::IntersectedBySphere(Vector3 center, float radius, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
+	SphereQuery sphere(center, radius, returnArray, returnArrayMaxSize);
+	CountOperations(0, 1);
+	index->Traverse(sphere);
+	return sphere.Count();
+};
+
+/// Returns the items whose bounds come within radius of the segment from start to end in the supplied array,
+/// which must already be allocated.
+int SpatialPartitioner::IntersectedByCapsule(Vector3 start, Vector3 end, float radius, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
+	CapsuleQuery capsule(start, end, radius, returnArray, returnArrayMaxSize);
+	CountOperations(0, 1);
+	index->Traverse(capsule);
+	return capsule.Count();
+};
+
+/// Returns the items whose bounds overlap the frustum bounded by the six planes in the supplied array, which
+/// must already be allocated, and whether each is inside the frustum or crosses its boundary in overlapArray.
+int SpatialPartitioner::IntersectedByFrustum(const float* planes, int* returnArray, int* overlapArray, int returnArrayMaxSize) {
+	FlushUpdates();
+	FrustumQuery frustum(planes, returnArray, returnArrayMaxSize, overlapArray);
+	CountOperations(0, 1);
+	index->Traverse(frustum);
+	return frustum.Count();
+};
+
+/// Returns the items whose bounds intersect the rotated box in the supplied array, which must already be
+/// allocated.
+int SpatialPartitioner::IntersectedByOrientedBox(Vector3 center, Vector3 extents, const float* rotation, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
+	OrientedBoxQuery box(center, extents, rotation, false, returnArray, returnArrayMaxSize);
+	CountOperations(0, 1);
+	index->Traverse(box);
+	return box.Count();
+};
+
+/// Returns the items whose bounds lie inside the rotated box in the supplied array, which must already be
+/// allocated.
+int SpatialPartitioner::ContainedByOrientedBox(Vector3 center, Vector3 extents, const float* rotation, int* returnArray, int returnArrayMaxSize) {
+	FlushUpdates();
+	OrientedBoxQuery box(center, extents, rotation, true, returnArray, returnArrayMaxSize);
+	CountOperations(0, 1);
+	index->Traverse(box);
+	return box.Count();
+};
+
+/// Writes up to maxPairs pairs of items whose bounds intersect to pairArray, as two ids each, lower id first,
+/// and returns the number written. The pairs are found on the thread pool on the first call, kept until the last
+/// page is returned, and dropped then.
+int SpatialPartitioner::FindOverlappingPairs(int* pairArray, int maxPairs, int* cursor) {
+	FlushUpdates();
+	if (*cursor < 0) return 0;
+	if (*cursor > 0 && (pairs.empty() || pairVersion != version)) {
+		*cursor = 0;
+		return -1;
+	}
+	if (*cursor == 0) {
+		CountOperations(0, 1);
+		pairs.clear();
+		::FindOverlappingPairs(elementVector.data(), (int)elementVector.size(), pairs);
+		pairVersion = version;
+	}
+
+	int pairCount = (int)(pairs.size() / 2);
+	int first = std::min(*cursor, pairCount);
+	int count = std::max(std::min(maxPairs, pairCount - first), 0);
+	std::copy(pairs.begin() + 2 * first, pairs.begin() + 2 * (first + count), pairArray);
+	*cursor = first + count;
+	if (*cursor >= pairCount) {
+		*cursor = -1;
+		std::vector<int>().swap(pairs);
+	}
+	return count;
+};
+
+/// Publishes the items as they are now to the Read queries, and frees the snapshots published before that no
+/// reader is left on.
+void SpatialPartitioner::Publish() {
+	std::shared_ptr<const SpatialSnapshot> snapshot = Snapshot();
+	if (snapshot == publishedSnapshot) return;
+	published = snapshot.get();
+	EpochReclaimer& reclaimer = EpochReclaimer::Instance();
+	if (publishedSnapshot) {
+		RetiredSnapshot retired = { reclaimer.Advance(), publishedSnapshot };
+		retiredSnapshots.push_back(retired);
+	}
+	publishedSnapshot = snapshot;
+	retiredSnapshots.erase(std::remove_if(retiredSnapshots.begin(), retiredSnapshots.end(),
+		[&reclaimer](const RetiredSnapshot& retired) { return reclaimer.ReadersLeft(retired.epoch); }), retiredSnapshots.end());
+};
+
+/// Like ContainedBy, on the items as of the last Publish.
+int SpatialPartitioner::ReadContainedBy(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) const {
+	int id = -1;
+	AABB testAABB = AABB(id, testCenter, testExtents);
+	EpochReclaimer::ReadGuard guard;
+	const SpatialSnapshot* snapshot = published;
+	return snapshot != nullptr ? snapshot->ContainedBy(testAABB, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Like IntersectedBy, on the items as of the last Publish.
+int SpatialPartitioner::ReadIntersectedBy(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) const {
+	int id = -1;
+	AABB testAABB = AABB(id, testCenter, testExtents);
+	EpochReclaimer::ReadGuard guard;
+	const SpatialSnapshot* snapshot = published;
+	return snapshot != nullptr ? snapshot->IntersectedBy(testAABB, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Like Raycast, on the items as of the last Publish.
+int SpatialPartitioner::ReadRaycast(Vector3 origin, Vector3 direction, float maxDistance, int* hitArray, float* distanceArray, int maxHits) const {
+	EpochReclaimer::ReadGuard guard;
+	const SpatialSnapshot* snapshot = published;
+	return snapshot != nullptr ? snapshot->Raycast(origin, direction, maxDistance, hitArray, distanceArray, maxHits) : 0;
+};
+
+/// Like Nearest, on the items as of the last Publish.
+int SpatialPartitioner::ReadNearest(Vector3 point, float maxDistance, int* returnArray, float* squaredDistanceArray, int maxCount) const {
+	EpochReclaimer::ReadGuard guard;
+	const SpatialSnapshot* snapshot = published;
+	return snapshot != nullptr ? snapshot->Nearest(point, maxDistance, returnArray, squaredDistanceArray, maxCount) : 0;
+};
+
+/// Returns a snapshot of the items as they are now, sharing the pages of items unchanged since the last snapshot
+/// or Publish.
+std::shared_ptr<const SpatialSnapshot> SpatialPartitioner::Snapshot() {
+	FlushUpdates();
+	return snapshots.Build(elementVector, version);
+};
+
 /// Checks whether this partitioner contains an item with the supplied handle.
 bool SpatialPartitioner::HasItem(int itemHandle) {
-	return idToIndex.find(itemHandle) != idToIndex.end();
-};
\ No newline at end of file
+	FlushUpdates();
+	return idToIndex.Find(itemHandle) != ItemIdMap::kMissing;
+};
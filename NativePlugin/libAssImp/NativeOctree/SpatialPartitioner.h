@@ -1,47 +1,62 @@
 #pragma once
 #include "libAssImp\VectorTypes.h"
-#include <unordered_map>
+#include "AABB.h"
+#include "SpatialIndex.h"
+#include "SpatialSnapshot.h"
+#include "ItemIdMap.h"
+#include <atomic>
+#include <vector>
 #include <memory>
 #include <cstdint>
 
-struct Elem;
-struct SweepSortAABB;
-
+class SpatialPartitioner {
+public:
+	SpatialPartitioner();
 
-struct AABB {
-	
-	__m128 vecmax;
-	__m128 vecmin;
+	/// Creates a partitioner for a world volume with the given center and size. A loose octree over that
+	/// volume backs the partitioner if the size is non-degenerate, and a dynamic AABB tree otherwise.
+	SpatialPartitioner(Vector3 worldCenter, Vector3 worldSize);
 
-	AABB(int32_t id, Vector3 center, Vector3 extents) {
-		__m128 v_center = _mm_set_ps(reinterpret_cast<float &>(id), center.z, center.y, center.x);
-		__m128 v_extents = _mm_set_ps(0, extents.z, extents.y, extents.x);
-		vecmin = _mm_sub_ps(v_center, v_extents);
-		vecmax = _mm_add_ps(v_center, v_extents);
-	};
+	/// Creates a partitioner backed by a loose octree over the given world volume, with explicit depth and
+	/// looseness.
+	SpatialPartitioner(Vector3 worldCenter, Vector3 worldSize, int octreeMaxDepth, float octreeLooseness);
 
-	AABB() {};
-	AABB& operator=(const AABB& other) {
-		vecmax = other.vecmax;
-		vecmin = other.vecmin;
-		return *this;
-	}
-};
+	/// Creates a partitioner for the given world volume backed by the given acceleration structure. With
+	/// SPATIAL_BACKEND_AUTO, the backend is chosen from the item count, the spread of item sizes and the ratio of
+	/// updates to queries, and the items are moved to a different backend when the workload changes.
+	SpatialPartitioner(Vector3 worldCenter, Vector3 worldSize, SpatialPartitionerBackend backend);
 
-class SpatialPartitioner {
-public:
-	SpatialPartitioner();
-	~SpatialPartitioner() {};
+	/// Waits for any readers still on the published snapshot.
+	~SpatialPartitioner();
 
 	/// Adds an item as itemId with the specified bounds.
 	void AddItem(int itemId, Vector3 &itemBoundsCenter, Vector3 &itemBoundsExtents);
 
-	/// Updates an item with the specified id.
+	/// Adds count items at once, as itemIds with the bounds at the same positions in centers and extents. Ids
+	/// that are already present are updated instead.
+	void BulkLoad(const int* itemIds, const Vector3* centers, const Vector3* extents, int count);
+
+	/// Updates an item with the specified id. Unknown ids are ignored.
 	void UpdateItem(int itemId, Vector3 itemBoundsCenter, Vector3 itemBoundsExtents);
 
-	/// Removes an item with the specified id.
+	/// Removes an item with the specified id. Unknown ids are ignored.
 	void RemoveItem(int itemId);
 
+	/// Updates count items at once, as itemIds with the bounds at the same positions in centers and extents. The index
+	/// restructures once for the whole batch. Ids that aren't present are skipped.
+	void UpdateItems(const int* itemIds, const Vector3* centers, const Vector3* extents, int count);
+
+	/// Removes count items at once. The index restructures once for the whole batch. Ids that aren't present are skipped.
+	void RemoveItems(const int* itemIds, int count);
+
+	/// Turns deferred updates on or off. While on, AddItem, UpdateItem and RemoveItem only queue their change, with
+	/// later changes to an id replacing earlier ones, and the queue is applied in one batch right before the next
+	/// query, batched change, snapshot or publish, or FlushUpdates. Turning it off applies the queue.
+	void SetDeferredUpdates(bool deferred);
+
+	/// Applies the changes queued in deferred mode.
+	void FlushUpdates();
+
 	/// Tests whether the AABB defined by testCenter and testExtents fully contains any elements, and returns them in the supplied array
 	/// which must already be allocated.
 	int ContainedBy(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize);
@@ -54,12 +69,186 @@ public:
 	/// which must already be allocated.
 	int IntersectedByOrig(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize);
 
+	/// Like ContainedBy, but writes the total number of matching elements to totalCount instead of dropping the ones past
+	/// returnArrayMaxSize. If they don't all fit, *cursor receives a cursor for NextPage to continue from, and otherwise -1.
+	int ContainedByPaged(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount);
+
+	/// Like IntersectedBy, but writes the total number of matching elements to totalCount instead of dropping the ones past
+	/// returnArrayMaxSize. If they don't all fit, *cursor receives a cursor for NextPage to continue from, and otherwise -1.
+	int IntersectedByPaged(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount);
+
+	/// Writes the next results of the paged query behind *cursor to returnArray and returns their number. Sets *cursor to
+	/// -1 once the last results are written. Returns -1 and sets *cursor to 0 if the cursor is unknown, or the items
+	/// changed since the query ran; the query has to be run again.
+	int NextPage(int* cursor, int* returnArray, int returnArrayMaxSize);
+
+	/// Drops the results of a paged query that won't be read to the end.
+	void ReleaseCursor(int cursor);
+
+	/// Runs queryCount box queries, each finding the elements that box intersects, or fully contains if its entry in
+	/// containedFlags is non-zero. containedFlags may be null to intersect with every box. The ids found by query i go to
+	/// returnArray from offsets[i] up to offsets[i + 1], so offsets needs queryCount + 1 entries. Queries are answered
+	/// in order until one doesn't fit in what is left of returnArray; it and the queries after it get empty ranges.
+	/// Returns the number of queries answered. Queries whose boxes overlap share one traversal, and over enough elements
+	/// the traversals run on the thread pool.
+	int BatchQuery(const Vector3* centers, const Vector3* extents, const int* containedFlags, int queryCount,
+		int* offsets, int* returnArray, int returnArrayMaxSize);
+
+	/// Tests whether the AABB defined by testCenter and testExtents fully contains any elements, stopping at the first.
+	bool AnyContainedBy(Vector3 testCenter, Vector3 testExtents);
+
+	/// Tests whether the AABB defined by testCenter and testExtents intersects any elements, stopping at the first.
+	bool AnyIntersectedBy(Vector3 testCenter, Vector3 testExtents);
+
+	/// Returns the number of elements the AABB defined by testCenter and testExtents fully contains, without writing their ids.
+	int CountContainedBy(Vector3 testCenter, Vector3 testExtents);
+
+	/// Returns the number of elements the AABB defined by testCenter and testExtents intersects, without writing their ids.
+	int CountIntersectedBy(Vector3 testCenter, Vector3 testExtents);
+
+	/// Casts a ray from origin along direction and returns up to maxHits of the items whose bounds it passes
+	/// through within maxDistance, closest first, with the distance at which the ray enters each in
+	/// distanceArray. With maxHits 1 this finds the closest hit and stops looking right after.
+	int Raycast(Vector3 origin, Vector3 direction, float maxDistance, int* hitArray, float* distanceArray, int maxHits);
+
+	/// Returns up to maxCount of the items closest to point, by the distance from point to their bounds, closest
+	/// first, with their squared distances in squaredDistanceArray. Only items within maxDistance are returned;
+	/// pass infinity for no limit.
+	int Nearest(Vector3 point, float maxDistance, int* returnArray, float* squaredDistanceArray, int maxCount);
+
+	/// Returns the items whose bounds come within radius of center in the supplied array, which must already be
+	/// allocated.
+	int IntersectedBySphere(Vector3 center, float radius, int* returnArray, int returnArrayMaxSize);
+
+	/// Returns the items whose bounds come within radius of the segment from start to end in the supplied array,
+	/// which must already be allocated.
+	int IntersectedByCapsule(Vector3 start, Vector3 end, float radius, int* returnArray, int returnArrayMaxSize);
+
+	/// Returns the items whose bounds overlap the frustum bounded by the six planes, given as a normal and a
+	/// distance each, in the supplied array, which must already be allocated. If overlapArray isn't null, it
+	/// receives SPATIAL_INSIDE or SPATIAL_INTERSECTING for each item.
+	int IntersectedByFrustum(const float* planes, int* returnArray, int* overlapArray, int returnArrayMaxSize);
+
+	/// Returns the items whose bounds intersect the box of the given center and half extents rotated by the
+	/// quaternion rotation, given as x, y, z and w, in the supplied array, which must already be allocated.
+	int IntersectedByOrientedBox(Vector3 center, Vector3 extents, const float* rotation, int* returnArray, int returnArrayMaxSize);
+
+	/// Returns the items whose bounds lie inside the box of the given center and half extents rotated by the
+	/// quaternion rotation, given as x, y, z and w, in the supplied array, which must already be allocated.
+	int ContainedByOrientedBox(Vector3 center, Vector3 extents, const float* rotation, int* returnArray, int returnArrayMaxSize);
+
+	/// Writes up to maxPairs pairs of items whose bounds intersect to pairArray, as two ids each, lower id first,
+	/// and returns the number written. Start with *cursor 0; on return it holds where the next call continues,
+	/// or -1 once every pair has been returned. The pairs are found once, on the first call, and paged from
+	/// there. Returns -1 and resets *cursor to 0 if the items changed since the call that returned the cursor, and
+	/// the search has to start over.
+	int FindOverlappingPairs(int* pairArray, int maxPairs, int* cursor);
+
+	/// Publishes the items as they are now to the Read queries. Only the pages of items changed since the last
+	/// publish are copied; the rest are shared with the previous snapshot, which is freed once no reader is left on
+	/// it. Like every other call that doesn't start with Read, this must not run on more than one thread at once.
+	void Publish();
+
+	/// Like ContainedBy, on the items as of the last Publish. Any number of threads may run the Read queries at
+	/// once, including while another thread changes the items or publishes them.
+	int ReadContainedBy(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) const;
+
+	/// Like IntersectedBy, on the items as of the last Publish.
+	int ReadIntersectedBy(Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) const;
+
+	/// Like Raycast, on the items as of the last Publish.
+	int ReadRaycast(Vector3 origin, Vector3 direction, float maxDistance, int* hitArray, float* distanceArray, int maxHits) const;
+
+	/// Like Nearest, on the items as of the last Publish.
+	int ReadNearest(Vector3 point, float maxDistance, int* returnArray, float* squaredDistanceArray, int maxCount) const;
+
+	/// Returns a snapshot of the items as they are now, which later changes leave untouched. Only the pages of items
+	/// changed since the last snapshot or Publish are copied; the rest are shared with it.
+	std::shared_ptr<const SpatialSnapshot> Snapshot();
+
 	/// Checks whether this partitioner contains an item with the supplied handle.
 	bool HasItem(int itemHandle);
 
+	/// Returns the backend currently holding the items.
+	SpatialPartitionerBackend GetBackend() const;
+
 private:
-	std::vector<AABB> SpatialPartitioner::elementVector;
-	std::unordered_map<int, int> idToIndex;
+	/// Creates a partitioner for the given backend around index, or around the backend's default index if index
+	/// is nullptr.
+	SpatialPartitioner(Vector3 worldCenter, Vector3 worldSize, SpatialPartitionerBackend backend, SpatialIndex* index);
+
+	/// Counts operations towards the next automatic backend selection.
+	void CountOperations(int updates, int queries);
+	/// Picks the backend that suits the workload seen since the last selection, and moves the items to it.
+	void SelectBackend();
+	/// Rebuilds the index as backend from elementVector.
+	void MigrateTo(SpatialPartitionerBackend backend);
+	/// Runs a paged box query in one traversal, keeping the results that don't fit in returnArray for NextPage.
+	int QueryPaged(const AABB& testBounds, bool contained, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount);
+	/// Queues an add, or an update of an item that will be present, in deferred mode.
+	void QueueUpdate(int itemId, Vector3 center, Vector3 extents, bool add);
+	/// Queues the removal of an item that will be present, in deferred mode.
+	void QueueRemove(int itemId);
+
+	/// Results past the first page of a paged query still being read, and how many of them were read.
+	struct PagedQuery {
+		int cursor;
+		uint64_t version;
+		std::vector<int> ids;
+		size_t next;
+	};
+
+	/// The change queued for an item in deferred mode: the bounds it ends up with, or its removal.
+	struct PendingUpdate {
+		int itemId;
+		/// Whether the item is present once the change is applied.
+		bool present;
+		Vector3 center;
+		Vector3 extents;
+	};
+
+	/// A published snapshot replaced by a later one, and the epoch it was replaced in.
+	struct RetiredSnapshot {
+		uint64_t epoch;
+		std::shared_ptr<const SpatialSnapshot> snapshot;
+	};
+
+
+	std::vector<AABB> elementVector;
+	/// Index proxy of each element, parallel to elementVector.
+	std::vector<int> proxyVector;
+	/// Position of each item in elementVector, by id.
+	ItemIdMap idToIndex;
+	std::unique_ptr<SpatialIndex> index;
+	SpatialPartitionerBackend backend;
+	Vector3 worldCenter;
+	Vector3 worldSize;
+	/// Whether the backend is chosen automatically, and the choice of the last selection that didn't migrate.
+	bool autoSelect;
+	SpatialPartitionerBackend pendingBackend;
+	/// Adds, updates and removes, and queries, since the last automatic selection.
+	int updateCount;
+	int queryCount;
+	/// Incremented by every change to the items.
+	uint64_t version;
+	/// The overlapping pairs being paged out by FindOverlappingPairs, found at pairVersion.
+	std::vector<int> pairs;
+	uint64_t pairVersion;
+	/// Open paged queries, oldest first, and the cursor the next one gets.
+	std::vector<PagedQuery> pagedQueries;
+	int nextCursor;
+	/// Tracks the elements changed since the last snapshot.
+	SnapshotBuilder snapshots;
+	/// The snapshot the Read queries run on, owned by publishedSnapshot, and the snapshots it replaced that readers
+	/// may still be on.
+	std::atomic<const SpatialSnapshot*> published;
+	std::shared_ptr<const SpatialSnapshot> publishedSnapshot;
+	std::vector<RetiredSnapshot> retiredSnapshots;
+	/// Whether AddItem, UpdateItem and RemoveItem are queued, the queued changes, one per id, and the position of
+	/// each id's change in the queue.
+	bool deferUpdates;
+	std::vector<PendingUpdate> pendingUpdates;
+	ItemIdMap pendingIndex;
 };
 
 
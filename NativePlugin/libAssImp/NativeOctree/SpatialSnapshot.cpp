@@ -0,0 +1,258 @@
+#include "SpatialSnapshot.h"
+#include "ScanKernels.h"
+#include "QueryShapes.h"
+#include <algorithm>
+
+/// Items per page. A page is the unit a snapshot copies when any of its items changed, and that queries scan
+/// with the scan kernels.
+static const size_t kSnapshotPageSize = 256;
+
+/// Pages per block. Every new snapshot holds its own list of blocks, sharing the unchanged ones by pointer.
+static const size_t kSnapshotBlockPages = 64;
+
+namespace {
+	/// A block or page queued by TraverseNearest, at the visitor's distance to its bounds.
+	struct NearestEntry {
+		float distance;
+		size_t index;
+	};
+
+	bool Closer(const NearestEntry& a, const NearestEntry& b) {
+		return a.distance < b.distance;
+	}
+
+	/// Copies the elements from position begin up to end into a new page.
+	std::shared_ptr<const SnapshotPage> BuildPage(const std::vector<AABB>& elements, size_t begin, size_t end) {
+		std::shared_ptr<SnapshotPage> page = std::make_shared<SnapshotPage>();
+		page->boxes.Reserve(end - begin);
+		page->bounds = elements[begin];
+		for (size_t i = begin; i < end; i++) {
+			page->boxes.Push(IdFromAABB(elements[i]), elements[i]);
+			page->bounds = Union(page->bounds, elements[i]);
+		}
+		return page;
+	}
+
+	/// Cuts flags down to count entries, and releases its memory when it holds far more than that, so one large
+	/// change does not keep its flags for the builder's lifetime.
+	void TrimFlags(std::vector<char>& flags, size_t count) {
+		if (flags.size() > count) {
+			flags.resize(count);
+		}
+		if (flags.capacity() > 2 * flags.size() + 64) {
+			flags.shrink_to_fit();
+		}
+	}
+
+	/// Scans a page for the items passing contained or intersected by testBounds, and copies all its ids when
+	/// testBounds contains the whole page.
+	int ScanPage(const SnapshotPage& page, const AABB& testBounds, bool contained, int* returnArray, int returnArrayMaxSize) {
+		if (contains(testBounds, page.bounds)) {
+			int count = std::min((int)page.boxes.Size(), returnArrayMaxSize);
+			std::copy(page.boxes.ids.begin(), page.boxes.ids.begin() + count, returnArray);
+			return count;
+		}
+		return contained ? ScanContainedBy(page.boxes, testBounds, returnArray, returnArrayMaxSize)
+			: ScanIntersectedBy(page.boxes, testBounds, returnArray, returnArrayMaxSize);
+	}
+
+	/// Hands the items of a page to the visitor, classifying each unless the page lies inside the shape. Returns
+	/// false once the visitor asks to stop.
+	bool VisitPage(const SnapshotPage& page, SpatialVisitor& visitor, const AABB& testBounds, bool inside) {
+		for (size_t i = 0; i < page.boxes.Size(); i++) {
+			AABB bounds = page.boxes.Get(i);
+			SpatialOverlap overlap = SPATIAL_INSIDE;
+			if (!inside) {
+				if (!intersects(testBounds, bounds)) continue;
+				overlap = visitor.Classify(bounds);
+				if (overlap == SPATIAL_OUTSIDE) continue;
+			}
+			if (!visitor.Visit(page.boxes.ids[i], bounds, overlap)) return false;
+		}
+		return true;
+	}
+}
+
+SpatialSnapshot::SpatialSnapshot(std::vector<std::shared_ptr<const SnapshotBlock> > blocks, int itemCount, uint64_t version) :
+	blocks(std::move(blocks)), itemCount(itemCount), version(version) {
+
+};
+
+int SpatialSnapshot::ItemCount() const {
+	return itemCount;
+};
+
+uint64_t SpatialSnapshot::Version() const {
+	return version;
+};
+
+/// Scans the pages of the blocks testBounds intersects.
+int SpatialSnapshot::ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	for (size_t b = 0; b < blocks.size() && curNumResults < returnArrayMaxSize; b++) {
+		const SnapshotBlock& block = *blocks[b];
+		if (!intersects(testBounds, block.bounds)) continue;
+		for (size_t p = 0; p < block.pages.size() && curNumResults < returnArrayMaxSize; p++) {
+			const SnapshotPage& page = *block.pages[p];
+			if (!intersects(testBounds, page.bounds)) continue;
+			curNumResults += ScanPage(page, testBounds, true, returnArray + curNumResults, returnArrayMaxSize - curNumResults);
+		}
+	}
+	return curNumResults;
+};
+
+/// Scans the pages of the blocks testBounds intersects.
+int SpatialSnapshot::IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	for (size_t b = 0; b < blocks.size() && curNumResults < returnArrayMaxSize; b++) {
+		const SnapshotBlock& block = *blocks[b];
+		if (!intersects(testBounds, block.bounds)) continue;
+		for (size_t p = 0; p < block.pages.size() && curNumResults < returnArrayMaxSize; p++) {
+			const SnapshotPage& page = *block.pages[p];
+			if (!intersects(testBounds, page.bounds)) continue;
+			curNumResults += ScanPage(page, testBounds, false, returnArray + curNumResults, returnArrayMaxSize - curNumResults);
+		}
+	}
+	return curNumResults;
+};
+
+int SpatialSnapshot::Raycast(Vector3 origin, Vector3 direction, float maxDistance, int* hitArray, float* distanceArray, int maxHits) const {
+	RayQuery ray(origin, direction, maxDistance, maxHits);
+	TraverseNearest(ray);
+	return ray.Write(hitArray, distanceArray);
+};
+
+int SpatialSnapshot::Nearest(Vector3 point, float maxDistance, int* returnArray, float* squaredDistanceArray, int maxCount) const {
+	PointQuery query(point, maxDistance, maxCount);
+	TraverseNearest(query);
+	return query.Write(returnArray, squaredDistanceArray);
+};
+
+/// Classifies blocks, then pages, then items, and hands every item below a block or page classified inside to
+/// the visitor without classifying it.
+void SpatialSnapshot::Traverse(SpatialVisitor& visitor) const {
+	AABB testBounds = visitor.Bounds();
+	for (size_t b = 0; b < blocks.size(); b++) {
+		const SnapshotBlock& block = *blocks[b];
+		SpatialOverlap blockOverlap = visitor.Classify(block.bounds);
+		if (blockOverlap == SPATIAL_OUTSIDE) continue;
+		for (size_t p = 0; p < block.pages.size(); p++) {
+			const SnapshotPage& page = *block.pages[p];
+			SpatialOverlap pageOverlap = blockOverlap == SPATIAL_INSIDE ? SPATIAL_INSIDE : visitor.Classify(page.bounds);
+			if (pageOverlap == SPATIAL_OUTSIDE) continue;
+			if (!VisitPage(page, visitor, testBounds, pageOverlap == SPATIAL_INSIDE)) return;
+		}
+	}
+};
+
+/// Opens blocks, and the pages within each, in order of their distance, and stops at the first beyond the
+/// visitor's MaxDistance.
+void SpatialSnapshot::TraverseNearest(NearestVisitor& visitor) const {
+	std::vector<NearestEntry> blockOrder;
+	for (size_t b = 0; b < blocks.size(); b++) {
+		NearestEntry entry = { visitor.Distance(blocks[b]->bounds), b };
+		if (entry.distance >= 0 && entry.distance <= visitor.MaxDistance()) {
+			blockOrder.push_back(entry);
+		}
+	}
+	std::sort(blockOrder.begin(), blockOrder.end(), Closer);
+
+	std::vector<NearestEntry> pageOrder;
+	for (size_t b = 0; b < blockOrder.size(); b++) {
+		if (blockOrder[b].distance > visitor.MaxDistance()) return;
+		const SnapshotBlock& block = *blocks[blockOrder[b].index];
+		pageOrder.clear();
+		for (size_t p = 0; p < block.pages.size(); p++) {
+			NearestEntry entry = { visitor.Distance(block.pages[p]->bounds), p };
+			if (entry.distance >= 0 && entry.distance <= visitor.MaxDistance()) {
+				pageOrder.push_back(entry);
+			}
+		}
+		std::sort(pageOrder.begin(), pageOrder.end(), Closer);
+
+		for (size_t p = 0; p < pageOrder.size(); p++) {
+			if (pageOrder[p].distance > visitor.MaxDistance()) break;
+			const SnapshotPage& page = *block.pages[pageOrder[p].index];
+			for (size_t i = 0; i < page.boxes.Size(); i++) {
+				AABB bounds = page.boxes.Get(i);
+				float distance = visitor.Distance(bounds);
+				if (distance >= 0 && distance <= visitor.MaxDistance()) {
+					visitor.Visit(page.boxes.ids[i], bounds, distance);
+				}
+			}
+		}
+	}
+};
+
+/// Records that the element at position element changed, was added or was removed.
+void SnapshotBuilder::MarkChanged(size_t element) {
+	size_t page = element / kSnapshotPageSize;
+	if (page >= changedPages.size()) {
+		changedPages.resize(page + 1, 0);
+		changedBlocks.resize(page / kSnapshotBlockPages + 1, 0);
+	}
+	changedPages[page] = 1;
+	changedBlocks[page / kSnapshotBlockPages] = 1;
+};
+
+/// Records that the elements from position begin up to end changed, were added or were removed.
+void SnapshotBuilder::MarkChanged(size_t begin, size_t end) {
+	if (begin >= end) return;
+	size_t lastPage = (end - 1) / kSnapshotPageSize;
+	if (lastPage >= changedPages.size()) {
+		changedPages.resize(lastPage + 1, 0);
+		changedBlocks.resize(lastPage / kSnapshotBlockPages + 1, 0);
+	}
+	for (size_t page = begin / kSnapshotPageSize; page <= lastPage; page++) {
+		changedPages[page] = 1;
+		changedBlocks[page / kSnapshotBlockPages] = 1;
+	}
+};
+
+/// Shares the blocks and pages holding no changed elements with the previous snapshot, and copies the rest from
+/// elements.
+std::shared_ptr<const SpatialSnapshot> SnapshotBuilder::Build(const std::vector<AABB>& elements, uint64_t version) {
+	if (latest && latest->Version() == version) return latest;
+
+	size_t pageCount = (elements.size() + kSnapshotPageSize - 1) / kSnapshotPageSize;
+	size_t blockCount = (pageCount + kSnapshotBlockPages - 1) / kSnapshotBlockPages;
+	const std::vector<std::shared_ptr<const SnapshotBlock> >* previous = latest ? &latest->blocks : nullptr;
+	std::vector<std::shared_ptr<const SnapshotBlock> > blocks(blockCount);
+	for (size_t b = 0; b < blockCount; b++) {
+		const SnapshotBlock* oldBlock = previous != nullptr && b < previous->size() ? (*previous)[b].get() : nullptr;
+		bool blockChanged = b < changedBlocks.size() && changedBlocks[b] != 0;
+		if (oldBlock != nullptr && !blockChanged) {
+			blocks[b] = (*previous)[b];
+			continue;
+		}
+
+		std::shared_ptr<SnapshotBlock> block = std::make_shared<SnapshotBlock>();
+		size_t firstPage = b * kSnapshotBlockPages;
+		size_t lastPage = std::min(firstPage + kSnapshotBlockPages, pageCount);
+		for (size_t p = firstPage; p < lastPage; p++) {
+			size_t slot = p - firstPage;
+			bool pageChanged = p < changedPages.size() && changedPages[p] != 0;
+			std::shared_ptr<const SnapshotPage> page;
+			if (oldBlock != nullptr && slot < oldBlock->pages.size() && !pageChanged) {
+				page = oldBlock->pages[slot];
+			}
+			else {
+				size_t begin = p * kSnapshotPageSize;
+				page = BuildPage(elements, begin, std::min(begin + kSnapshotPageSize, elements.size()));
+			}
+			if (pageChanged) {
+				changedPages[p] = 0;
+			}
+			block->bounds = slot == 0 ? page->bounds : Union(block->bounds, page->bounds);
+			block->pages.push_back(page);
+		}
+		if (blockChanged) {
+			changedBlocks[b] = 0;
+		}
+		blocks[b] = block;
+	}
+	TrimFlags(changedPages, pageCount);
+	TrimFlags(changedBlocks, blockCount);
+	latest = std::make_shared<const SpatialSnapshot>(std::move(blocks), (int)elements.size(), version);
+	return latest;
+};
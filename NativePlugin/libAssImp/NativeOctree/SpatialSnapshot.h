@@ -0,0 +1,84 @@
+#pragma once
+#include "AABB.h"
+#include "AABBArray.h"
+#include "SpatialVisitor.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// A run of consecutive items of a snapshot, with the bounds enclosing them all.
+struct SnapshotPage {
+	AABBArray boxes;
+	AABB bounds;
+};
+
+/// A run of consecutive pages of a snapshot, with the bounds enclosing them all.
+struct SnapshotBlock {
+	std::vector<std::shared_ptr<const SnapshotPage> > pages;
+	AABB bounds;
+};
+
+/// The items of a SpatialPartitioner frozen at one version. Nothing in a snapshot changes once it is built, so
+/// any number of threads can query it at once, and consecutive snapshots share the pages and blocks that didn't
+/// change between them. Items are kept in the partitioner's element order, and queries skip the blocks and
+/// pages whose bounds miss the query before scanning the items of the rest.
+class SpatialSnapshot {
+public:
+	SpatialSnapshot(std::vector<std::shared_ptr<const SnapshotBlock> > blocks, int itemCount, uint64_t version);
+
+	/// Returns the number of items.
+	int ItemCount() const;
+
+	/// Returns the partitioner's version the snapshot was taken at.
+	uint64_t Version() const;
+
+	/// Writes the ids of items fully contained by testBounds into returnArray, stopping at returnArrayMaxSize.
+	int ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const;
+
+	/// Writes the ids of items intersecting testBounds into returnArray, stopping at returnArrayMaxSize.
+	int IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const;
+
+	/// Writes up to maxHits of the items hit by the ray into hitArray, nearest first, like SpatialPartitioner::Raycast.
+	int Raycast(Vector3 origin, Vector3 direction, float maxDistance, int* hitArray, float* distanceArray, int maxHits) const;
+
+	/// Writes up to maxCount of the items closest to point into returnArray, closest first, like
+	/// SpatialPartitioner::Nearest.
+	int Nearest(Vector3 point, float maxDistance, int* returnArray, float* squaredDistanceArray, int maxCount) const;
+
+	/// Hands the items overlapping the visitor's shape to the visitor, like SpatialIndex::Traverse.
+	void Traverse(SpatialVisitor& visitor) const;
+
+	/// Hands the items within the visitor's MaxDistance to the visitor, opening blocks and pages closest first,
+	/// like SpatialIndex::TraverseNearest.
+	void TraverseNearest(NearestVisitor& visitor) const;
+
+private:
+	friend class SnapshotBuilder;
+
+	std::vector<std::shared_ptr<const SnapshotBlock> > blocks;
+	int itemCount;
+	uint64_t version;
+};
+
+/// Builds the snapshots of a partitioner's elements. The partitioner reports every element it writes, and a new
+/// snapshot copies only the pages holding those, sharing the rest with the previous snapshot, so its cost
+/// follows the items changed since rather than the items held.
+class SnapshotBuilder {
+public:
+	/// Records that the element at position element changed, was added or was removed.
+	void MarkChanged(size_t element);
+
+	/// Records that the elements from position begin up to end changed, were added or were removed.
+	void MarkChanged(size_t begin, size_t end);
+
+	/// Returns a snapshot of elements at version, which is the previous snapshot if it was built at the same
+	/// version.
+	std::shared_ptr<const SpatialSnapshot> Build(const std::vector<AABB>& elements, uint64_t version);
+
+private:
+	/// The last snapshot built, which the next one shares its unchanged pages with.
+	std::shared_ptr<const SpatialSnapshot> latest;
+	/// Whether each page, and each block, holds elements changed since latest was built.
+	std::vector<char> changedPages;
+	std::vector<char> changedBlocks;
+};
@@ -0,0 +1,151 @@
+#pragma once
+#include "AABB.h"
+#include <vector>
+
+/// How a box relates to a query shape.
+enum SpatialOverlap {
+	SPATIAL_OUTSIDE = 0,
+	SPATIAL_INTERSECTING = 1,
+	SPATIAL_INSIDE = 2,
+};
+
+/// Query shape driving SpatialIndex::Traverse. Backends classify the bounds of their nodes or cells to skip
+/// the parts of the index outside the shape, and hand every item below a node classified inside to Visit
+/// without classifying it.
+class SpatialVisitor {
+public:
+	virtual ~SpatialVisitor() {};
+
+	/// Returns a box enclosing everything the shape can overlap. Backends without a hierarchy narrow their
+	/// candidates with it before classifying them.
+	virtual AABB Bounds() const = 0;
+
+	/// Classifies bounds against the shape. SPATIAL_INTERSECTING is always a safe answer for a node, since it
+	/// only means the node is opened.
+	virtual SpatialOverlap Classify(const AABB& bounds) const = 0;
+
+	/// Receives an item classified as intersecting or inside the shape, or lying below a node classified as
+	/// inside. Returns false to end the traversal.
+	virtual bool Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) = 0;
+};
+
+/// Counts the items lying inside a box, or intersecting it if contained isn't set, and ends the traversal once
+/// maxCount are found. Backs the box queries that only need to know how many items match, or whether any do.
+class BoxCounter : public SpatialVisitor {
+public:
+	BoxCounter(const AABB& testBounds, bool contained, int maxCount) :
+		testBounds(testBounds), contained(contained), maxCount(maxCount), count(0) {};
+
+	AABB Bounds() const override {
+		return testBounds;
+	};
+
+	SpatialOverlap Classify(const AABB& bounds) const override {
+		if (!intersects(testBounds, bounds)) return SPATIAL_OUTSIDE;
+		return contains(testBounds, bounds) ? SPATIAL_INSIDE : SPATIAL_INTERSECTING;
+	};
+
+	bool Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) override {
+		if (contained && overlap != SPATIAL_INSIDE) return true;
+		count++;
+		return count < maxCount;
+	};
+
+	/// Returns the number of items counted.
+	int Count() const {
+		return count;
+	};
+
+private:
+	AABB testBounds;
+	bool contained;
+	int maxCount;
+	int count;
+};
+
+/// Collects the items lying inside a box, or intersecting it if contained isn't set, into returnArray, and the
+/// ones that don't fit into an overflow list, so a single traversal finds them all. Backs the paged box queries.
+class BoxCollector : public SpatialVisitor {
+public:
+	BoxCollector(const AABB& testBounds, bool contained, int* returnArray, int returnArrayMaxSize, std::vector<int>& overflow) :
+		testBounds(testBounds), contained(contained), returnArray(returnArray), returnArrayMaxSize(returnArrayMaxSize),
+		overflow(overflow), count(0) {};
+
+	AABB Bounds() const override {
+		return testBounds;
+	};
+
+	SpatialOverlap Classify(const AABB& bounds) const override {
+		if (!intersects(testBounds, bounds)) return SPATIAL_OUTSIDE;
+		return contains(testBounds, bounds) ? SPATIAL_INSIDE : SPATIAL_INTERSECTING;
+	};
+
+	bool Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) override {
+		if (contained && overlap != SPATIAL_INSIDE) return true;
+		if (count < returnArrayMaxSize) {
+			returnArray[count++] = itemId;
+		}
+		else {
+			overflow.push_back(itemId);
+		}
+		return true;
+	};
+
+	/// Returns the number of items written to returnArray.
+	int Count() const {
+		return count;
+	};
+
+private:
+	AABB testBounds;
+	bool contained;
+	int* returnArray;
+	int returnArrayMaxSize;
+	std::vector<int>& overflow;
+	int count;
+};
+
+/// Query shape driving SpatialIndex::TraverseNearest, which looks for the items closest to the shape by some
+/// distance the shape defines.
+class NearestVisitor {
+public:
+	virtual ~NearestVisitor() {};
+
+	/// Returns a box enclosing everything the shape can reach within its initial MaxDistance.
+	virtual AABB Bounds() const = 0;
+
+	/// Returns the shape's distance to the closest point of bounds, or a negative value if the shape can't
+	/// reach bounds at all. Never more than the distance to any box inside bounds.
+	virtual float Distance(const AABB& bounds) const = 0;
+
+	/// Returns the distance beyond which no more items are wanted. It may shrink as items are visited.
+	virtual float MaxDistance() const = 0;
+
+	/// Receives an item at the given distance, which is at most MaxDistance.
+	virtual void Visit(int itemId, const AABB& bounds, float distance) = 0;
+};
+
+/// Adapts a NearestVisitor to an unordered traversal, for backends without an ordered one. Boxes beyond the
+/// visitor's current MaxDistance are classified outside, so the search still tightens as items are found.
+class NearestFilter : public SpatialVisitor {
+public:
+	NearestFilter(NearestVisitor& nearest) : nearest(nearest) {};
+
+	AABB Bounds() const override {
+		return nearest.Bounds();
+	};
+
+	SpatialOverlap Classify(const AABB& bounds) const override {
+		float distance = nearest.Distance(bounds);
+		return distance >= 0 && distance <= nearest.MaxDistance() ? SPATIAL_INTERSECTING : SPATIAL_OUTSIDE;
+	};
+
+	bool Visit(int itemId, const AABB& bounds, SpatialOverlap overlap) override {
+		// Items are always classified, since Classify never answers inside.
+		nearest.Visit(itemId, bounds, nearest.Distance(bounds));
+		return true;
+	};
+
+private:
+	NearestVisitor& nearest;
+};
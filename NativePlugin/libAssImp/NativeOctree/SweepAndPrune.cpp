@@ -0,0 +1,306 @@
+#include "SweepAndPrune.h"
+#include <algorithm>
+#include <cmath>
+
+static const int kNullIndex = -1;
+
+/// Relative slack applied when widening a query by the longest interval, so float rounding in the interval
+/// lengths can't drop an item that only just reaches the query.
+static const float kLengthSlack = 1e-5f;
+
+static bool MinLess(const SweepSortAABB& a, const SweepSortAABB& b) {
+	return a.min < b.min;
+}
+
+static bool IsRemoved(const SweepSortAABB& entry) {
+	return entry.elem == kNullIndex;
+}
+
+SweepAndPrune::SweepAndPrune(int axisCount) : sortedCount(0), removedCount(0), freeElem(kNullIndex), liveCount(0) {
+	this->axisCount = std::min(std::max(axisCount, 1), 3);
+	for (int axis = 0; axis < 3; axis++) {
+		maxLength[axis] = 0;
+		maxLengthStale[axis] = false;
+	}
+};
+
+int SweepAndPrune::Insert(int itemId, const AABB& bounds) {
+	int elem;
+	if (freeElem != kNullIndex) {
+		elem = freeElem;
+		freeElem = elems[elem].itemId;
+	}
+	else {
+		elem = (int)elems.size();
+		elems.push_back(Elem());
+	}
+	elems[elem].bounds = bounds;
+	elems[elem].itemId = itemId;
+
+	float boundsMin[4];
+	float boundsMax[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	_mm_storeu_ps(boundsMax, bounds.vecmax);
+	for (int axis = 0; axis < axisCount; axis++) {
+		SweepSortAABB entry;
+		entry.min = boundsMin[axis];
+		entry.max = boundsMax[axis];
+		entry.elem = elem;
+		elems[elem].sortIndex[axis] = (int)axes[axis].size();
+		axes[axis].push_back(entry);
+		maxLength[axis] = std::max(maxLength[axis], entry.max - entry.min);
+	}
+	liveCount++;
+	return elem;
+};
+
+/// Moves the item behind proxy to new bounds, re-sorting its entries in place.
+void SweepAndPrune::Update(int proxy, const AABB& bounds) {
+	elems[proxy].bounds = bounds;
+	float boundsMin[4];
+	float boundsMax[4];
+	_mm_storeu_ps(boundsMin, bounds.vecmin);
+	_mm_storeu_ps(boundsMax, bounds.vecmax);
+	for (int axis = 0; axis < axisCount; axis++) {
+		int position = elems[proxy].sortIndex[axis];
+		SweepSortAABB& entry = axes[axis][position];
+		float oldLength = entry.max - entry.min;
+		entry.min = boundsMin[axis];
+		entry.max = boundsMax[axis];
+		float length = entry.max - entry.min;
+		if (length > maxLength[axis]) {
+			maxLength[axis] = length;
+		}
+		else if (length < oldLength && oldLength >= maxLength[axis]) {
+			maxLengthStale[axis] = true;
+		}
+		// Entries appended since the last query get sorted when they are merged.
+		if (position < sortedCount) {
+			SortEntry(axis, position);
+		}
+	}
+};
+
+/// Removes the item behind proxy. Its entries stay behind as tombstones until the next compaction.
+void SweepAndPrune::Remove(int proxy) {
+	for (int axis = 0; axis < axisCount; axis++) {
+		SweepSortAABB& entry = axes[axis][elems[proxy].sortIndex[axis]];
+		if (entry.max - entry.min >= maxLength[axis]) {
+			maxLengthStale[axis] = true;
+		}
+		entry.elem = kNullIndex;
+		elems[proxy].sortIndex[axis] = kNullIndex;
+	}
+	elems[proxy].itemId = freeElem;
+	freeElem = proxy;
+	removedCount++;
+	liveCount--;
+};
+
+void SweepAndPrune::Clear() {
+	elems.clear();
+	for (int axis = 0; axis < 3; axis++) {
+		axes[axis].clear();
+		maxLength[axis] = 0;
+		maxLengthStale[axis] = false;
+	}
+	freeElem = kNullIndex;
+	sortedCount = 0;
+	removedCount = 0;
+	liveCount = 0;
+};
+
+/// Restores sorted order on axis after the entry at position changed its min.
+void SweepAndPrune::SortEntry(int axis, int position) {
+	std::vector<SweepSortAABB>& entries = axes[axis];
+	SweepSortAABB moved = entries[position];
+	while (position > 0 && entries[position - 1].min > moved.min) {
+		entries[position] = entries[position - 1];
+		if (!IsRemoved(entries[position])) {
+			elems[entries[position].elem].sortIndex[axis] = position;
+		}
+		position--;
+	}
+	while (position + 1 < sortedCount && entries[position + 1].min < moved.min) {
+		entries[position] = entries[position + 1];
+		if (!IsRemoved(entries[position])) {
+			elems[entries[position].elem].sortIndex[axis] = position;
+		}
+		position++;
+	}
+	entries[position] = moved;
+	elems[moved.elem].sortIndex[axis] = position;
+};
+
+/// Rewrites every element's sortIndex for axis from the array order.
+void SweepAndPrune::Reindex(int axis) const {
+	const std::vector<SweepSortAABB>& entries = axes[axis];
+	for (int position = 0; position < (int)entries.size(); position++) {
+		if (!IsRemoved(entries[position])) {
+			elems[entries[position].elem].sortIndex[axis] = position;
+		}
+	}
+};
+
+/// Merges entries appended since the last query into the sorted arrays, and drops removed entries once
+/// they make up a large enough share of the arrays.
+void SweepAndPrune::Flush() const {
+	int entryCount = (int)axes[0].size();
+	bool compact = removedCount > 0 && removedCount * 4 > entryCount;
+	if (sortedCount == entryCount && !compact) return;
+
+	for (int axis = 0; axis < axisCount; axis++) {
+		std::vector<SweepSortAABB>& entries = axes[axis];
+		if (compact) {
+			entries.erase(std::remove_if(entries.begin(), entries.end(), IsRemoved), entries.end());
+		}
+		// Compaction keeps relative order, so the sorted prefix is still sorted, just shorter by however many
+		// of its entries were removed.
+		int sorted = compact ? (int)(std::is_sorted_until(entries.begin(), entries.end(), MinLess) - entries.begin()) : sortedCount;
+		std::sort(entries.begin() + sorted, entries.end(), MinLess);
+		std::inplace_merge(entries.begin(), entries.begin() + sorted, entries.end(), MinLess);
+		Reindex(axis);
+	}
+	if (compact) {
+		removedCount = 0;
+	}
+	sortedCount = (int)axes[0].size();
+};
+
+/// Merges pending entries and refreshes stale interval lengths, which queries otherwise do on first use.
+void SweepAndPrune::Prepare() const {
+	Flush();
+	for (int a = 0; a < axisCount; a++) {
+		if (maxLengthStale[a]) {
+			RefreshMaxLength(a);
+		}
+	}
+};
+
+/// Recomputes the longest interval on axis after the previous longest shrank or went away.
+void SweepAndPrune::RefreshMaxLength(int axis) const {
+	float length = 0;
+	const std::vector<SweepSortAABB>& entries = axes[axis];
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		if (!IsRemoved(*it)) {
+			length = std::max(length, it->max - it->min);
+		}
+	}
+	maxLength[axis] = length;
+	maxLengthStale[axis] = false;
+};
+
+/// Finds the axis and entry range [begin, end) holding the fewest candidates whose min lies in
+/// [lowest, highest].
+void SweepAndPrune::NarrowestRange(const float* lowest, const float* highest, int* axis, int* begin, int* end) const {
+	*axis = 0;
+	*begin = 0;
+	*end = 0;
+	int bestCount = -1;
+	for (int a = 0; a < axisCount; a++) {
+		const std::vector<SweepSortAABB>& entries = axes[a];
+		SweepSortAABB key;
+		key.min = lowest[a];
+		int first = (int)(std::lower_bound(entries.begin(), entries.end(), key, MinLess) - entries.begin());
+		key.min = highest[a];
+		int last = (int)(std::upper_bound(entries.begin() + first, entries.end(), key, MinLess) - entries.begin());
+		if (bestCount < 0 || last - first < bestCount) {
+			bestCount = last - first;
+			*axis = a;
+			*begin = first;
+			*end = last;
+		}
+	}
+};
+
+int SweepAndPrune::ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	if (liveCount == 0) return curNumResults;
+	Flush();
+
+	// A contained item's min lies inside the test box on every axis.
+	float testMin[4];
+	float testMax[4];
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+	int axis, begin, end;
+	NarrowestRange(testMin, testMax, &axis, &begin, &end);
+
+	const std::vector<SweepSortAABB>& entries = axes[axis];
+	for (int position = begin; position < end; position++) {
+		const SweepSortAABB& entry = entries[position];
+		if (IsRemoved(entry) || entry.max > testMax[axis]) continue;
+		const Elem& elem = elems[entry.elem];
+		if (contains(testBounds, elem.bounds)) {
+			returnArray[curNumResults] = elem.itemId;
+			curNumResults++;
+			if (curNumResults >= returnArrayMaxSize) return curNumResults;
+		}
+	}
+	return curNumResults;
+};
+
+int SweepAndPrune::IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const {
+	int curNumResults = 0;
+	if (liveCount == 0) return curNumResults;
+	Flush();
+
+	// An intersecting item's min can lie at most the longest interval to the left of the test box.
+	float testMin[4];
+	float testMax[4];
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+	float lowest[3];
+	for (int a = 0; a < axisCount; a++) {
+		if (maxLengthStale[a]) {
+			RefreshMaxLength(a);
+		}
+		lowest[a] = testMin[a] - maxLength[a] - (std::fabs(testMin[a]) + maxLength[a]) * kLengthSlack;
+	}
+	int axis, begin, end;
+	NarrowestRange(lowest, testMax, &axis, &begin, &end);
+
+	const std::vector<SweepSortAABB>& entries = axes[axis];
+	for (int position = begin; position < end; position++) {
+		const SweepSortAABB& entry = entries[position];
+		if (IsRemoved(entry) || entry.max < testMin[axis]) continue;
+		const Elem& elem = elems[entry.elem];
+		if (intersects(testBounds, elem.bounds)) {
+			returnArray[curNumResults] = elem.itemId;
+			curNumResults++;
+			if (curNumResults >= returnArrayMaxSize) return curNumResults;
+		}
+	}
+	return curNumResults;
+};
+
+/// Classifies the items intersecting the visitor's bounds, found as in IntersectedBy.
+void SweepAndPrune::Traverse(SpatialVisitor& visitor) const {
+	if (liveCount == 0) return;
+	Flush();
+
+	AABB testBounds = visitor.Bounds();
+	float testMin[4];
+	float testMax[4];
+	_mm_storeu_ps(testMin, testBounds.vecmin);
+	_mm_storeu_ps(testMax, testBounds.vecmax);
+	float lowest[3];
+	for (int a = 0; a < axisCount; a++) {
+		if (maxLengthStale[a]) {
+			RefreshMaxLength(a);
+		}
+		lowest[a] = testMin[a] - maxLength[a] - (std::fabs(testMin[a]) + maxLength[a]) * kLengthSlack;
+	}
+	int axis, begin, end;
+	NarrowestRange(lowest, testMax, &axis, &begin, &end);
+
+	const std::vector<SweepSortAABB>& entries = axes[axis];
+	for (int position = begin; position < end; position++) {
+		const SweepSortAABB& entry = entries[position];
+		if (IsRemoved(entry) || entry.max < testMin[axis]) continue;
+		const Elem& elem = elems[entry.elem];
+		if (!intersects(testBounds, elem.bounds)) continue;
+		SpatialOverlap overlap = visitor.Classify(elem.bounds);
+		if (overlap != SPATIAL_OUTSIDE && !visitor.Visit(elem.itemId, elem.bounds, overlap)) return;
+	}
+};
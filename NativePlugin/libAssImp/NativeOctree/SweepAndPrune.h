@@ -0,0 +1,70 @@
+#pragma once
+#include "AABB.h"
+#include "SpatialIndex.h"
+#include <vector>
+
+/// An item of the SweepAndPrune index.
+struct Elem {
+	AABB bounds;
+	/// The item's id, or the next free slot while the slot is free.
+	int itemId;
+	/// Position of this element's entry in each axis' sorted array, or -1 while the slot is free.
+	int sortIndex[3];
+};
+
+/// An element's interval along one sweep axis. Each axis keeps these sorted by min.
+struct SweepSortAABB {
+	float min;
+	float max;
+	/// The element this interval belongs to, or -1 for a removed entry awaiting compaction.
+	int elem;
+};
+
+/// Sweep-and-prune index that keeps the items' intervals sorted along one or more axes. Moves re-sort with
+/// insertion sort starting from the item's current position, which is close to free when items move a
+/// little between frames. Queries binary-search the axis that yields the fewest candidates and run the SSE
+/// overlap test only on those.
+class SweepAndPrune : public SpatialIndex {
+public:
+	/// Creates an index sorted along the first axisCount of x, y and z.
+	SweepAndPrune(int axisCount = 3);
+	~SweepAndPrune() {};
+
+	int Insert(int itemId, const AABB& bounds) override;
+	void Update(int proxy, const AABB& bounds) override;
+	void Remove(int proxy) override;
+	void Clear() override;
+	void Prepare() const override;
+	int ContainedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	int IntersectedBy(const AABB& testBounds, int* returnArray, int returnArrayMaxSize) const override;
+	void Traverse(SpatialVisitor& visitor) const override;
+
+private:
+	/// Merges entries appended since the last query into the sorted arrays, and drops removed entries once
+	/// they make up a large enough share of the arrays.
+	void Flush() const;
+	/// Restores sorted order on axis after the entry at position changed its min.
+	void SortEntry(int axis, int position);
+	/// Rewrites every element's sortIndex for axis from the array order.
+	void Reindex(int axis) const;
+	/// Recomputes the longest interval on axis after the previous longest shrank or went away.
+	void RefreshMaxLength(int axis) const;
+	/// Finds the axis and entry range [begin, end) holding the fewest candidates whose min lies in
+	/// [lowest, highest].
+	void NarrowestRange(const float* lowest, const float* highest, int* axis, int* begin, int* end) const;
+
+	/// The axis arrays are sorted lazily, so a run of inserts such as a model load costs one merge rather
+	/// than one shift each. Merging moves entries, so the elements' sortIndex is lazily maintained too.
+	mutable std::vector<Elem> elems;
+	mutable std::vector<SweepSortAABB> axes[3];
+	/// Entries before this position are sorted; the rest were appended since the last query.
+	mutable int sortedCount;
+	mutable int removedCount;
+	/// Upper bound on the interval length on each axis, which bounds how far left of a query an
+	/// intersecting item's min can be.
+	mutable float maxLength[3];
+	mutable bool maxLengthStale[3];
+	int freeElem;
+	int axisCount;
+	int liveCount;
+};
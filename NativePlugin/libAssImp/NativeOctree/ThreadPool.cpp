@@ -0,0 +1,200 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+/// Fewest items a query covers before it is split across the pool, until SetMinParallelItems says otherwise.
+/// Below this, waking the workers costs more than they save.
+static const int kDefaultMinParallelItems = 8192;
+
+/// Set on the threads running a ParallelFor body, so a ParallelFor called from one runs inline instead of trying
+/// the jobMutex its calling thread may already hold.
+static thread_local bool insideParallelFor = false;
+
+/// The pool is never destroyed. Its destructor would run while the library unloads, under the loader lock, where
+/// joining the workers hangs, since each has to take that lock to exit.
+ThreadPool& ThreadPool::Instance() {
+	static ThreadPool* pool = new ThreadPool();
+	return *pool;
+};
+
+ThreadPool::ThreadPool() : slotCount(0), workerCount(0), minParallelItems(kDefaultMinParallelItems), jobBody(nullptr),
+	jobGrain(1), jobNumber(0), jobOpen(false), busyWorkers(0), stopping(false) {
+	SetWorkerCount(-1);
+};
+
+/// Sets the number of worker threads, not counting the thread calling ParallelFor, and returns the count now in use.
+int ThreadPool::SetWorkerCount(int count) {
+	if (count < 0) {
+		count = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+	}
+	std::lock_guard<std::mutex> job(jobMutex);
+	if (count != workerCount) {
+		StopWorkers();
+		workerCount = count;
+	}
+	return count;
+};
+
+int ThreadPool::WorkerCount() const {
+	return workerCount;
+};
+
+void ThreadPool::SetMinParallelItems(int minItems) {
+	minParallelItems = std::max(minItems, 0);
+};
+
+bool ThreadPool::RunsInParallel(size_t items) const {
+	return workerCount > 0 && items >= (size_t)minParallelItems;
+};
+
+/// Calls body over ranges of at most grain covering [0, count), on the workers and the calling thread.
+void ThreadPool::ParallelFor(int count, int grain, const std::function<void(int, int)>& body) {
+	if (count <= 0) return;
+	grain = std::max(grain, 1);
+	std::unique_lock<std::mutex> job(jobMutex, std::defer_lock);
+	if (!insideParallelFor) {
+		job.try_lock();
+	}
+	if (!job.owns_lock() || workerCount == 0 || count <= grain) {
+		if (job.owns_lock()) {
+			job.unlock();
+		}
+		for (int begin = 0; begin < count; begin += std::min(grain, count - begin)) {
+			body(begin, begin + std::min(grain, count - begin));
+		}
+		return;
+	}
+
+	StartWorkers();
+	for (int slot = 0; slot < slotCount; slot++) {
+		shares[slot] = PackRange((int)((int64_t)count * slot / slotCount), (int)((int64_t)count * (slot + 1) / slotCount));
+	}
+	{
+		std::lock_guard<std::mutex> state(stateMutex);
+		jobBody = &body;
+		jobGrain = grain;
+		jobNumber++;
+		jobOpen = true;
+	}
+	jobReady.notify_all();
+
+	insideParallelFor = true;
+	RunSlot(0, body, grain);
+	insideParallelFor = false;
+
+	// Every share is empty once the calling thread runs out, but workers may still be on the ranges they took.
+	std::unique_lock<std::mutex> state(stateMutex);
+	jobDone.wait(state, [this] { return busyWorkers == 0; });
+	jobOpen = false;
+	jobBody = nullptr;
+};
+
+/// Starts the workers if none run yet.
+void ThreadPool::StartWorkers() {
+	if (!workers.empty() || workerCount == 0) return;
+	slotCount = workerCount + 1;
+	shares.reset(new std::atomic<uint64_t>[slotCount]);
+	for (int slot = 0; slot < slotCount; slot++) {
+		shares[slot] = PackRange(0, 0);
+	}
+	for (int slot = 1; slot < slotCount; slot++) {
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, slot));
+	}
+};
+
+/// Stops and joins the workers.
+void ThreadPool::StopWorkers() {
+	{
+		std::lock_guard<std::mutex> state(stateMutex);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	workers.clear();
+	stopping = false;
+};
+
+/// Waits for ParallelFor jobs and works on each.
+void ThreadPool::WorkerLoop(int slot) {
+	// Workers run nothing but bodies.
+	insideParallelFor = true;
+	uint64_t lastJob = 0;
+	std::unique_lock<std::mutex> state(stateMutex);
+	for (;;) {
+		jobReady.wait(state, [&] { return stopping || (jobOpen && jobNumber != lastJob); });
+		if (stopping) return;
+		lastJob = jobNumber;
+		const std::function<void(int, int)>& body = *jobBody;
+		int grain = jobGrain;
+		busyWorkers++;
+		state.unlock();
+
+		RunSlot(slot, body, grain);
+
+		state.lock();
+		busyWorkers--;
+		if (busyWorkers == 0) {
+			jobDone.notify_all();
+		}
+	}
+};
+
+/// Works through the share in slot a grain at a time, then steals from the other slots until none has anything left.
+void ThreadPool::RunSlot(int slot, const std::function<void(int, int)>& body, int grain) {
+	std::atomic<uint64_t>& share = shares[slot];
+	for (;;) {
+		uint64_t range = share.load();
+		int begin = RangeBegin(range);
+		int end = RangeEnd(range);
+		if (begin >= end) {
+			if (!Steal(slot, grain)) return;
+			continue;
+		}
+		int taken = begin + std::min(grain, end - begin);
+		if (!share.compare_exchange_weak(range, PackRange(taken, end))) continue;
+		body(begin, taken);
+	}
+};
+
+/// Takes the back half of the largest share other than slot's, or all of it if it is only a grain, and makes it
+/// slot's share.
+bool ThreadPool::Steal(int slot, int grain) {
+	for (;;) {
+		int victim = -1;
+		uint64_t victimRange = 0;
+		int victimSize = 0;
+		for (int other = 0; other < slotCount; other++) {
+			if (other == slot) continue;
+			uint64_t range = shares[other].load();
+			int size = RangeEnd(range) - RangeBegin(range);
+			if (size > victimSize) {
+				victim = other;
+				victimRange = range;
+				victimSize = size;
+			}
+		}
+		if (victim < 0) return false;
+
+		// A share's value is exactly the range nobody has claimed yet, so if the victim's share still holds the
+		// value read above, splitting it is safe even if it was passed around in between.
+		int begin = RangeBegin(victimRange);
+		int end = RangeEnd(victimRange);
+		int split = victimSize > grain ? begin + victimSize / 2 : begin;
+		if (!shares[victim].compare_exchange_strong(victimRange, PackRange(begin, split))) continue;
+		shares[slot] = PackRange(split, end);
+		return true;
+	}
+};
+
+uint64_t ThreadPool::PackRange(int begin, int end) {
+	return ((uint64_t)(uint32_t)begin << 32) | (uint32_t)end;
+};
+
+int ThreadPool::RangeBegin(uint64_t range) {
+	return (int)(uint32_t)(range >> 32);
+};
+
+int ThreadPool::RangeEnd(uint64_t range) {
+	return (int)(uint32_t)range;
+};
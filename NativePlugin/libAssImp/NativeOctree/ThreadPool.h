@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Worker threads shared by every partitioner for queries large enough to split. A ParallelFor deals its range
+/// out evenly among the workers and the calling thread, each of which works through its own share a grain at a
+/// time and, once it runs dry, steals half of whatever share is largest, so a thread that drew the expensive
+/// part of the range doesn't hold up the others. The workers start on first use.
+class ThreadPool {
+public:
+	/// Returns the pool shared by the library. It is never destroyed, so the workers run until SetWorkerCount(0)
+	/// stops them or the process exits.
+	static ThreadPool& Instance();
+
+	/// Sets the number of worker threads, not counting the thread calling ParallelFor. A negative count picks
+	/// one fewer than the hardware threads. Returns the count now in use. Waits for a running ParallelFor.
+	int SetWorkerCount(int count);
+
+	/// Returns the number of worker threads.
+	int WorkerCount() const;
+
+	/// Sets the fewest items a query has to cover before it is split across the pool.
+	void SetMinParallelItems(int minItems);
+
+	/// Returns whether work covering items items is worth splitting across the pool.
+	bool RunsInParallel(size_t items) const;
+
+	/// Calls body(begin, end) over ranges of at most grain that together cover [0, count), across the workers
+	/// and the calling thread, and returns once all are done. The ranges are disjoint but run in no particular
+	/// order. Runs everything on the calling thread if there are no workers, if the range fits one grain, if it is
+	/// called from the body of another ParallelFor, or if another thread's ParallelFor holds the pool.
+	void ParallelFor(int count, int grain, const std::function<void(int, int)>& body);
+
+private:
+	ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/// Starts the workers if none run yet. Called with jobMutex held.
+	void StartWorkers();
+	/// Stops and joins the workers. Called with jobMutex held.
+	void StopWorkers();
+	/// Waits for ParallelFor jobs and works on each.
+	void WorkerLoop(int slot);
+	/// Works through the share in slot, then steals from the other slots until none has anything left.
+	void RunSlot(int slot, const std::function<void(int, int)>& body, int grain);
+	/// Takes the back half of the largest share other than slot's, or all of it if it is only a grain, and
+	/// makes it slot's share. Returns false if every share is empty.
+	bool Steal(int slot, int grain);
+
+	/// Shares are packed as begin in the high half and end in the low half, so a share is taken or split with
+	/// a single compare and swap.
+	static uint64_t PackRange(int begin, int end);
+	static int RangeBegin(uint64_t range);
+	static int RangeEnd(uint64_t range);
+
+	std::vector<std::thread> workers;
+	/// The remaining share of each participant, the calling thread in slot 0 and worker i in slot i + 1.
+	std::unique_ptr<std::atomic<uint64_t>[]> shares;
+	int slotCount;
+	std::atomic<int> workerCount;
+	std::atomic<int> minParallelItems;
+
+	/// Held for the whole of a ParallelFor, and while the workers are started or stopped.
+	std::mutex jobMutex;
+	/// Guards the job fields below and the workers' waits.
+	std::mutex stateMutex;
+	std::condition_variable jobReady;
+	std::condition_variable jobDone;
+	const std::function<void(int, int)>* jobBody;
+	int jobGrain;
+	/// Counts the jobs started, so a worker tells a new job from the one it just finished.
+	uint64_t jobNumber;
+	/// Set while a job accepts workers. Cleared by the calling thread once all workers have left it.
+	bool jobOpen;
+	int busyWorkers;
+	bool stopping;
+};
@@ -2,8 +2,13 @@
 #include "DllExports.h"
 #include "FBXSupport.h"
 #include "NativeOctree\SpatialPartitioner.h"
+#include "NativeOctree\ScanKernels.h"
+#include "NativeOctree\ThreadPool.h"
+#include "NativeOctree\EpochReclaimer.h"
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <iostream>
 #include <fstream>
 
@@ -55,8 +60,66 @@ BLOCKSEXPORT void FinishExport() {
 	FinishExport_Internal();
 }
 
-static std::unordered_map<int, SpatialPartitioner> SpatialPartitionerMap = {};
-static int nextSpatialPartitionerId = 0;
+/// A handle packs the position of its partitioner's slot in SpatialPartitionerSlots into its low bits, and the
+/// slot's generation into the bits above.
+static const int kHandleSlotBits = 20;
+static const int kHandleSlotMask = (1 << kHandleSlotBits) - 1;
+static const int kHandleGenerationMask = (1 << (31 - kHandleSlotBits)) - 1;
+
+/// A slot of the handle table. Freeing a partitioner bumps its slot's generation, so the slot can be reused
+/// while handles to the freed partitioner stop matching it.
+struct SpatialPartitionerSlot {
+	std::unique_ptr<SpatialPartitioner> partitioner;
+	int generation;
+	/// The next free slot while this one is free, or -1.
+	int nextFree;
+};
+
+static std::vector<SpatialPartitionerSlot> SpatialPartitionerSlots;
+static int firstFreeSpatialPartitionerSlot = -1;
+/// Guards SpatialPartitionerSlots and firstFreeSpatialPartitionerSlot. Lookups share it, so queries on different
+/// threads don't serialize on it; allocating and freeing take it exclusively.
+static std::shared_timed_mutex SpatialPartitionerSlotsMutex;
+
+/// Returns the slot handle points to if the handle is current, or nullptr. Takes no lock.
+static SpatialPartitionerSlot* FindSpatialPartitionerSlot(int handle) {
+	if (handle < 0) return nullptr;
+	size_t slot = handle & kHandleSlotMask;
+	if (slot >= SpatialPartitionerSlots.size()) return nullptr;
+	SpatialPartitionerSlot& found = SpatialPartitionerSlots[slot];
+	if (!found.partitioner || found.generation != (handle >> kHandleSlotBits)) return nullptr;
+	return &found;
+}
+
+/// Returns the SpatialPartitioner behind handle, or nullptr if the handle is unknown or its partitioner was
+/// freed. A partitioner doesn't move while it is allocated, so the pointer stays valid after the lock is
+/// released, until the partitioner is freed.
+static SpatialPartitioner* FindSpatialPartitioner(int handle) {
+	std::shared_lock<std::shared_timed_mutex> lock(SpatialPartitionerSlotsMutex);
+	SpatialPartitionerSlot* slot = FindSpatialPartitionerSlot(handle);
+	return slot != nullptr ? slot->partitioner.get() : nullptr;
+}
+
+/// Puts partitioner in a free slot, reusing freed ones first, and returns its handle, or frees it and returns -1
+/// if every slot is taken.
+static int AddSpatialPartitioner(SpatialPartitioner* partitioner) {
+	std::unique_ptr<SpatialPartitioner> owned(partitioner);
+	std::lock_guard<std::shared_timed_mutex> lock(SpatialPartitionerSlotsMutex);
+	int slot = firstFreeSpatialPartitionerSlot;
+	if (slot >= 0) {
+		firstFreeSpatialPartitionerSlot = SpatialPartitionerSlots[slot].nextFree;
+	}
+	else {
+		if (SpatialPartitionerSlots.size() > (size_t)kHandleSlotMask) return -1;
+		slot = (int)SpatialPartitionerSlots.size();
+		SpatialPartitionerSlot added = { nullptr, 0, -1 };
+		SpatialPartitionerSlots.push_back(std::move(added));
+	}
+	SpatialPartitionerSlot& free = SpatialPartitionerSlots[slot];
+	free.partitioner = std::move(owned);
+	free.nextFree = -1;
+	return (free.generation << kHandleSlotBits) | slot;
+}
 
 #ifdef BLOCKS_DEBUG
 void InitCommandLog(int handle);
@@ -79,16 +142,73 @@ void WriteCommand(int handle, std::string name, int arg0, int arg1, int arg2, in
 /// Allocates an SpatialPartitioner and returns a handle.
 BLOCKSEXPORT int AllocSpatialPartitioner(Vector3 center, Vector3 size) {
 	//Debug("In AllocSpatialPartitioner");
-	int id = nextSpatialPartitionerId++;
+	int id = AddSpatialPartitioner(new SpatialPartitioner(center, size));
 #ifdef BLOCKS_DEBUG
 	int arg0 = WriteVector3Setup(id, center);
 	int arg1 = WriteVector3Setup(id, size);
 	InitCommandLog(id);
 #endif // BLOCKS_DEBUG
-	SpatialPartitionerMap[id] = SpatialPartitioner();
 	return id;
 };
 
+/// Allocates an SpatialPartitioner backed by a loose octree with the given depth and looseness, and returns a handle.
+BLOCKSEXPORT int AllocSpatialPartitionerOctree(Vector3 center, Vector3 size, int maxDepth, float looseness) {
+	int id = AddSpatialPartitioner(new SpatialPartitioner(center, size, maxDepth, looseness));
+#ifdef BLOCKS_DEBUG
+	int arg0 = WriteVector3Setup(id, center);
+	int arg1 = WriteVector3Setup(id, size);
+	InitCommandLog(id);
+#endif // BLOCKS_DEBUG
+	return id;
+};
+
+/// Allocates an SpatialPartitioner backed by the given backend, or chosen automatically, and returns a handle.
+BLOCKSEXPORT int AllocSpatialPartitionerWithBackend(Vector3 center, Vector3 size, int backend) {
+	int id = AddSpatialPartitioner(new SpatialPartitioner(center, size, (SpatialPartitionerBackend)backend));
+#ifdef BLOCKS_DEBUG
+	int arg0 = WriteVector3Setup(id, center);
+	int arg1 = WriteVector3Setup(id, size);
+	InitCommandLog(id);
+#endif // BLOCKS_DEBUG
+	return id;
+};
+
+/// Frees a SpatialPartitioner and its items. The handle, and any copy of it, stops working.
+BLOCKSEXPORT void FreeSpatialPartitioner(int SpatialPartitionerHandle) {
+	std::unique_ptr<SpatialPartitioner> partitioner;
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(SpatialPartitionerSlotsMutex);
+		SpatialPartitionerSlot* slot = FindSpatialPartitionerSlot(SpatialPartitionerHandle);
+		if (slot == nullptr) return;
+		partitioner = std::move(slot->partitioner);
+		slot->generation = (slot->generation + 1) & kHandleGenerationMask;
+		slot->nextFree = firstFreeSpatialPartitionerSlot;
+		firstFreeSpatialPartitionerSlot = SpatialPartitionerHandle & kHandleSlotMask;
+	}
+	// Deleted outside the lock, since the destructor waits for Read queries still running on the partitioner.
+};
+
+/// Returns the backend currently holding a SpatialPartitioner's items.
+BLOCKSEXPORT int SpatialPartitionerGetBackend(int SpatialPartitionerHandle) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->GetBackend() : -1;
+};
+
+/// Returns the level of the scan kernels in use.
+BLOCKSEXPORT int SpatialPartitionerGetScanKernel() {
+	return GetScanKernelLevel();
+};
+
+/// Sets the number of worker threads large queries are split across, and returns the count now in use.
+BLOCKSEXPORT int SpatialPartitionerSetWorkerThreads(int count) {
+	return ThreadPool::Instance().SetWorkerCount(count);
+};
+
+/// Sets the fewest items a query has to cover before it is split across the worker threads.
+BLOCKSEXPORT void SpatialPartitionerSetParallelThreshold(int minItems) {
+	ThreadPool::Instance().SetMinParallelItems(minItems);
+};
+
 /// Allocates an SpatialPartitioner and returns a handle.
 BLOCKSEXPORT void SpatialPartitionerAddItem(int SpatialPartitionerHandle, int itemId, Vector3 itemBoundsCenter, Vector3 itemBoundsSize) {
 #ifdef BLOCKS_DEBUG
@@ -97,7 +217,60 @@ BLOCKSEXPORT void SpatialPartitionerAddItem(int SpatialPartitionerHandle, int it
 	int arg2 = WriteVector3Setup(SpatialPartitionerHandle, itemBoundsSize);
 	WriteCommand(SpatialPartitionerHandle, "AddItem", arg0, arg1, arg2);
 #endif // BLOCKS_DEBUG
-	SpatialPartitionerMap[SpatialPartitionerHandle].AddItem(itemId, itemBoundsCenter, itemBoundsSize);
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->AddItem(itemId, itemBoundsCenter, itemBoundsSize);
+};
+
+/// Adds count items to a SpatialPartitioner in one call.
+BLOCKSEXPORT void SpatialPartitionerBulkLoad(int SpatialPartitionerHandle, int* ids, Vector3* centers, Vector3* extents, int count) {
+#ifdef BLOCKS_DEBUG
+	// Logged as the equivalent AddItem calls, so the command log replays without array setup.
+	for (int i = 0; i < count; i++) {
+		int arg0 = WriteIntSetup(SpatialPartitionerHandle, ids[i]);
+		int arg1 = WriteVector3Setup(SpatialPartitionerHandle, centers[i]);
+		int arg2 = WriteVector3Setup(SpatialPartitionerHandle, extents[i]);
+		WriteCommand(SpatialPartitionerHandle, "AddItem", arg0, arg1, arg2);
+	}
+#endif // BLOCKS_DEBUG
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->BulkLoad(ids, centers, extents, count);
+};
+
+/// Adds several items in one call.
+BLOCKSEXPORT void SpatialPartitionerAddItems(int SpatialPartitionerHandle, int* ids, Vector3* centers, Vector3* extents, int count) {
+	SpatialPartitionerBulkLoad(SpatialPartitionerHandle, ids, centers, extents, count);
+};
+
+/// Updates several items in one call.
+BLOCKSEXPORT void SpatialPartitionerUpdateItems(int SpatialPartitionerHandle, int* ids, Vector3* centers, Vector3* extents, int count) {
+#ifdef BLOCKS_DEBUG
+	// Logged as the equivalent UpdateItem calls, like BulkLoad.
+	for (int i = 0; i < count; i++) {
+		int arg0 = WriteIntSetup(SpatialPartitionerHandle, ids[i]);
+		int arg1 = WriteVector3Setup(SpatialPartitionerHandle, centers[i]);
+		int arg2 = WriteVector3Setup(SpatialPartitionerHandle, extents[i]);
+		WriteCommand(SpatialPartitionerHandle, "UpdateItem", arg0, arg1, arg2);
+	}
+#endif // BLOCKS_DEBUG
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->UpdateItems(ids, centers, extents, count);
+};
+
+/// Removes several items in one call.
+BLOCKSEXPORT void SpatialPartitionerRemoveItems(int SpatialPartitionerHandle, int* ids, int count) {
+#ifdef BLOCKS_DEBUG
+	// Logged as the equivalent RemoveItem calls, like BulkLoad.
+	for (int i = 0; i < count; i++) {
+		int arg0 = WriteIntSetup(SpatialPartitionerHandle, ids[i]);
+		WriteCommand(SpatialPartitionerHandle, "RemoveItem", arg0);
+	}
+#endif // BLOCKS_DEBUG
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->RemoveItems(ids, count);
 };
 
 /// Allocates an SpatialPartitioner and returns a handle.
@@ -108,7 +281,9 @@ BLOCKSEXPORT void SpatialPartitionerUpdateItem(int SpatialPartitionerHandle, int
 	int arg2 = WriteVector3Setup(SpatialPartitionerHandle, itemBoundsSize);
 	WriteCommand(SpatialPartitionerHandle, "UpdateItem", arg0, arg1, arg2);
 #endif // BLOCKS_DEBUG
-	SpatialPartitionerMap[SpatialPartitionerHandle].UpdateItem(itemId, itemBoundsCenter, itemBoundsSize);
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->UpdateItem(itemId, itemBoundsCenter, itemBoundsSize);
 };
 
 /// Allocates an SpatialPartitioner and returns a handle.
@@ -117,7 +292,23 @@ BLOCKSEXPORT void SpatialPartitionerRemoveItem(int SpatialPartitionerHandle, int
 	int arg0 = WriteIntSetup(SpatialPartitionerHandle, itemId);
 	WriteCommand(SpatialPartitionerHandle, "RemoveItem", arg0);
 #endif // BLOCKS_DEBUG
-	SpatialPartitionerMap[SpatialPartitionerHandle].RemoveItem(itemId);
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->RemoveItem(itemId);
+};
+
+/// Turns deferred updates on or off for a SpatialPartitioner.
+BLOCKSEXPORT void SpatialPartitionerSetDeferredUpdates(int SpatialPartitionerHandle, int deferred) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->SetDeferredUpdates(deferred != 0);
+};
+
+/// Applies the changes a SpatialPartitioner queued in deferred mode.
+BLOCKSEXPORT void SpatialPartitionerFlushUpdates(int SpatialPartitionerHandle) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->FlushUpdates();
 };
 
 /// Allocates an SpatialPartitioner and returns a handle.
@@ -129,7 +320,8 @@ BLOCKSEXPORT int SpatialPartitionerContainedBy(int SpatialPartitionerHandle, Vec
 	int arg3 = WriteIntSetup(SpatialPartitionerHandle, returnArrayMaxSize);
 	WriteCommand(SpatialPartitionerHandle, "ContainedBy", arg0, arg1, arg2, arg3);
 #endif // BLOCKS_DEBUG
-	return SpatialPartitionerMap[SpatialPartitionerHandle].ContainedBy(testCenter, testExtents, returnArray, returnArrayMaxSize);
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->ContainedBy(testCenter, testExtents, returnArray, returnArrayMaxSize) : 0;
 };
 
 /// Allocates an SpatialPartitioner and returns a handle.
@@ -141,13 +333,227 @@ BLOCKSEXPORT int SpatialPartitionerIntersectedBy(int SpatialPartitionerHandle, V
 	int arg3 = WriteIntSetup(SpatialPartitionerHandle, returnArrayMaxSize);
 	WriteCommand(SpatialPartitionerHandle, "IntersectedBy", arg0, arg1, arg2, arg3);
 #endif // BLOCKS_DEBUG
-	return SpatialPartitionerMap[SpatialPartitionerHandle].IntersectedBy(testCenter, testExtents, returnArray, returnArrayMaxSize);
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->IntersectedBy(testCenter, testExtents, returnArray, returnArrayMaxSize) : 0;
 };
 
 /// Allocates an SpatialPartitioner and returns a handle.
 BLOCKSEXPORT int SpatialPartitionerIntersectedByOrig(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) {
 	//Debug("In SpatialPartitionerIntersectedBy");
-	return SpatialPartitionerMap[SpatialPartitionerHandle].IntersectedByOrig(testCenter, testExtents, returnArray, returnArrayMaxSize);
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->IntersectedByOrig(testCenter, testExtents, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Box query reporting the total number of items it contains, paged through a cursor.
+BLOCKSEXPORT int SpatialPartitionerContainedByPaged(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->ContainedByPaged(testCenter, testExtents, returnArray, returnArrayMaxSize, cursor, totalCount) : 0;
+};
+
+/// Box query reporting the total number of items it intersects, paged through a cursor.
+BLOCKSEXPORT int SpatialPartitionerIntersectedByPaged(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize, int* cursor, int* totalCount) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->IntersectedByPaged(testCenter, testExtents, returnArray, returnArrayMaxSize, cursor, totalCount) : 0;
+};
+
+/// Continues a paged query.
+BLOCKSEXPORT int SpatialPartitionerNextPage(int SpatialPartitionerHandle, int* cursor, int* returnArray, int returnArrayMaxSize) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->NextPage(cursor, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Drops a paged query.
+BLOCKSEXPORT void SpatialPartitionerReleaseCursor(int SpatialPartitionerHandle, int cursor) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->ReleaseCursor(cursor);
+};
+
+/// Runs several box queries in one call, packing their results one after another.
+BLOCKSEXPORT int SpatialPartitionerBatchQuery(int SpatialPartitionerHandle, Vector3* centers, Vector3* extents, int* containedFlags, int queryCount, int* offsets, int* ids, int maxIds) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->BatchQuery(centers, extents, containedFlags, queryCount, offsets, ids, maxIds) : 0;
+};
+
+/// Tests whether a box fully contains any item.
+BLOCKSEXPORT int SpatialPartitionerAnyContainedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr && partitioner->AnyContainedBy(testCenter, testExtents) ? 1 : 0;
+};
+
+/// Tests whether a box intersects any item.
+BLOCKSEXPORT int SpatialPartitionerAnyIntersectedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr && partitioner->AnyIntersectedBy(testCenter, testExtents) ? 1 : 0;
+};
+
+/// Counts the items a box fully contains.
+BLOCKSEXPORT int SpatialPartitionerCountContainedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->CountContainedBy(testCenter, testExtents) : 0;
+};
+
+/// Counts the items a box intersects.
+BLOCKSEXPORT int SpatialPartitionerCountIntersectedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->CountIntersectedBy(testCenter, testExtents) : 0;
+};
+
+/// Casts a ray and returns the items it hits, closest first.
+BLOCKSEXPORT int SpatialPartitionerRaycast(int SpatialPartitionerHandle, Vector3 origin, Vector3 direction, float maxDistance, int* hits, float* distances, int maxHits) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->Raycast(origin, direction, maxDistance, hits, distances, maxHits) : 0;
+};
+
+/// Returns the k items closest to a point, closest first.
+BLOCKSEXPORT int SpatialPartitionerNearest(int SpatialPartitionerHandle, Vector3 point, float maxDistance, int* returnArray, float* squaredDistances, int k) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->Nearest(point, maxDistance, returnArray, squaredDistances, k) : 0;
+};
+
+/// Returns the items within a sphere.
+BLOCKSEXPORT int SpatialPartitionerSphereQuery(int SpatialPartitionerHandle, Vector3 center, float radius, int* returnArray, int returnArrayMaxSize) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->IntersectedBySphere(center, radius, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Returns the items within a capsule.
+BLOCKSEXPORT int SpatialPartitionerCapsuleQuery(int SpatialPartitionerHandle, Vector3 start, Vector3 end, float radius, int* returnArray, int returnArrayMaxSize) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->IntersectedByCapsule(start, end, radius, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Returns the items within a frustum, and whether each is inside or crossing it.
+BLOCKSEXPORT int SpatialPartitionerFrustumQuery(int SpatialPartitionerHandle, float* planes, int* returnArray, int* classifications, int returnArrayMaxSize) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->IntersectedByFrustum(planes, returnArray, classifications, returnArrayMaxSize) : 0;
+};
+
+/// Returns the items intersecting a rotated box.
+BLOCKSEXPORT int SpatialPartitionerIntersectedByOrientedBox(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, float* rotation, int* returnArray, int returnArrayMaxSize) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->IntersectedByOrientedBox(testCenter, testExtents, rotation, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Returns the items inside a rotated box.
+BLOCKSEXPORT int SpatialPartitionerContainedByOrientedBox(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, float* rotation, int* returnArray, int returnArrayMaxSize) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->ContainedByOrientedBox(testCenter, testExtents, rotation, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Pages out the pairs of intersecting items.
+BLOCKSEXPORT int SpatialPartitionerFindOverlappingPairs(int SpatialPartitionerHandle, int* pairs, int maxPairs, int* cursor) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->FindOverlappingPairs(pairs, maxPairs, cursor) : 0;
+};
+
+/// Publishes a SpatialPartitioner's items to the Read queries.
+BLOCKSEXPORT void SpatialPartitionerPublish(int SpatialPartitionerHandle) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->Publish();
+};
+
+/// Returns the published items a box fully contains. Safe to call from any thread.
+BLOCKSEXPORT int SpatialPartitionerReadContainedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) {
+	EpochReclaimer::ReadGuard guard;
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->ReadContainedBy(testCenter, testExtents, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Returns the published items a box intersects. Safe to call from any thread.
+BLOCKSEXPORT int SpatialPartitionerReadIntersectedBy(int SpatialPartitionerHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) {
+	EpochReclaimer::ReadGuard guard;
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->ReadIntersectedBy(testCenter, testExtents, returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Casts a ray against the published items. Safe to call from any thread.
+BLOCKSEXPORT int SpatialPartitionerReadRaycast(int SpatialPartitionerHandle, Vector3 origin, Vector3 direction, float maxDistance, int* hits, float* distances, int maxHits) {
+	EpochReclaimer::ReadGuard guard;
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->ReadRaycast(origin, direction, maxDistance, hits, distances, maxHits) : 0;
+};
+
+/// Returns the k published items closest to a point. Safe to call from any thread.
+BLOCKSEXPORT int SpatialPartitionerReadNearest(int SpatialPartitionerHandle, Vector3 point, float maxDistance, int* returnArray, float* squaredDistances, int k) {
+	EpochReclaimer::ReadGuard guard;
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	return partitioner != nullptr ? partitioner->ReadNearest(point, maxDistance, returnArray, squaredDistances, k) : 0;
+};
+
+static std::unordered_map<int, std::shared_ptr<const SpatialSnapshot> > SpatialSnapshotMap = {};
+static int nextSpatialSnapshotId = 0;
+/// Guards SpatialSnapshotMap and nextSpatialSnapshotId. Queries hold it only to copy out the snapshot's pointer.
+static std::mutex SpatialSnapshotMapMutex;
+
+/// Returns the snapshot behind handle, or nullptr if the handle is unknown or was released.
+static std::shared_ptr<const SpatialSnapshot> GetSpatialSnapshot(int handle) {
+	std::lock_guard<std::mutex> lock(SpatialSnapshotMapMutex);
+	auto found = SpatialSnapshotMap.find(handle);
+	return found != SpatialSnapshotMap.end() ? found->second : nullptr;
+}
+
+/// Takes a snapshot of a SpatialPartitioner's items and returns a handle to it.
+BLOCKSEXPORT int SpatialPartitionerSnapshot(int SpatialPartitionerHandle) {
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return -1;
+	std::shared_ptr<const SpatialSnapshot> snapshot = partitioner->Snapshot();
+	std::lock_guard<std::mutex> lock(SpatialSnapshotMapMutex);
+	int id = nextSpatialSnapshotId++;
+	SpatialSnapshotMap[id] = snapshot;
+	return id;
+};
+
+/// Releases a snapshot handle.
+BLOCKSEXPORT void FreeSpatialSnapshot(int SpatialSnapshotHandle) {
+	std::shared_ptr<const SpatialSnapshot> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(SpatialSnapshotMapMutex);
+		auto found = SpatialSnapshotMap.find(SpatialSnapshotHandle);
+		if (found == SpatialSnapshotMap.end()) return;
+		snapshot.swap(found->second);
+		SpatialSnapshotMap.erase(found);
+	}
+	// The pages only this snapshot held are freed here, outside the lock.
+};
+
+/// Returns the number of items in a snapshot.
+BLOCKSEXPORT int SpatialSnapshotItemCount(int SpatialSnapshotHandle) {
+	std::shared_ptr<const SpatialSnapshot> snapshot = GetSpatialSnapshot(SpatialSnapshotHandle);
+	return snapshot ? snapshot->ItemCount() : 0;
+};
+
+/// Returns the version of the SpatialPartitioner a snapshot was taken at.
+BLOCKSEXPORT long long SpatialSnapshotGetVersion(int SpatialSnapshotHandle) {
+	std::shared_ptr<const SpatialSnapshot> snapshot = GetSpatialSnapshot(SpatialSnapshotHandle);
+	return snapshot ? (long long)snapshot->Version() : -1;
+};
+
+/// Returns the items of a snapshot a box fully contains.
+BLOCKSEXPORT int SpatialSnapshotContainedBy(int SpatialSnapshotHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) {
+	std::shared_ptr<const SpatialSnapshot> snapshot = GetSpatialSnapshot(SpatialSnapshotHandle);
+	int id = -1;
+	return snapshot ? snapshot->ContainedBy(AABB(id, testCenter, testExtents), returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Returns the items of a snapshot a box intersects.
+BLOCKSEXPORT int SpatialSnapshotIntersectedBy(int SpatialSnapshotHandle, Vector3 testCenter, Vector3 testExtents, int* returnArray, int returnArrayMaxSize) {
+	std::shared_ptr<const SpatialSnapshot> snapshot = GetSpatialSnapshot(SpatialSnapshotHandle);
+	int id = -1;
+	return snapshot ? snapshot->IntersectedBy(AABB(id, testCenter, testExtents), returnArray, returnArrayMaxSize) : 0;
+};
+
+/// Casts a ray against the items of a snapshot.
+BLOCKSEXPORT int SpatialSnapshotRaycast(int SpatialSnapshotHandle, Vector3 origin, Vector3 direction, float maxDistance, int* hits, float* distances, int maxHits) {
+	std::shared_ptr<const SpatialSnapshot> snapshot = GetSpatialSnapshot(SpatialSnapshotHandle);
+	return snapshot ? snapshot->Raycast(origin, direction, maxDistance, hits, distances, maxHits) : 0;
+};
+
+/// Returns the k items of a snapshot closest to a point.
+BLOCKSEXPORT int SpatialSnapshotNearest(int SpatialSnapshotHandle, Vector3 point, float maxDistance, int* returnArray, float* squaredDistances, int k) {
+	std::shared_ptr<const SpatialSnapshot> snapshot = GetSpatialSnapshot(SpatialSnapshotHandle);
+	return snapshot ? snapshot->Nearest(point, maxDistance, returnArray, squaredDistances, k) : 0;
 };
 
 /// Allocates an SpatialPartitioner and returns a handle.
@@ -156,7 +562,9 @@ BLOCKSEXPORT void SpatialPartitionerHasItem(int SpatialPartitionerHandle, int it
 	int arg0 = WriteIntSetup(SpatialPartitionerHandle, itemHandle);
 	WriteCommand(SpatialPartitionerHandle, "HasItem", arg0);
 #endif // BLOCKS_DEBUG
-	SpatialPartitionerMap[SpatialPartitionerHandle].HasItem(itemHandle);
+	SpatialPartitioner* partitioner = FindSpatialPartitioner(SpatialPartitionerHandle);
+	if (partitioner == nullptr) return;
+	partitioner->HasItem(itemHandle);
 };
 
 #ifdef BLOCKS_DEBUG